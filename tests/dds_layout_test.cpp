@@ -0,0 +1,144 @@
+// Checks DDS::Parse against the textures in tools/ and against broken files.
+//
+//   dds-layout-test file.DDS...
+//
+// Every file given is expected to be a 512x512 BC3 texture with one mip,
+// which is what texconv writes for the textures of the game.
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "DDSLayout.h"
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool ok, const std::string &what, const char *expr)
+	{
+		if (ok)
+			return;
+		fprintf(stderr, "FAIL %s: %s\n", what.c_str(), expr);
+		failures++;
+	}
+
+#define CHECK(what, expr) check((expr), (what), #expr)
+
+	bool read_file(const char *path, std::vector<uint8_t> &out)
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (!in.is_open())
+			return false;
+		out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	DDS::DDS_HEADER *header_of(std::vector<uint8_t> &file)
+	{
+		return reinterpret_cast<DDS::DDS_HEADER*>(file.data() + sizeof(uint32_t));
+	}
+
+	void check_game_texture(const char *path)
+	{
+		std::string what = path;
+		std::vector<uint8_t> file;
+		if (!read_file(path, file))
+		{
+			CHECK(what, !"can't read the file");
+			return;
+		}
+
+		DDS::LAYOUT layout;
+		CHECK(what, DDS::Parse(file.data(), file.size(), 0, layout) == DDS::RESULT_OK);
+		CHECK(what, layout.dimension == DDS::DIMENSION_TEXTURE2D);
+		CHECK(what, layout.format == DXGI_FORMAT_BC3_UNORM);
+		CHECK(what, layout.width == 512 && layout.height == 512 && layout.depth == 1);
+		CHECK(what, layout.mipCount == 1 && layout.arraySize == 1 && !layout.isCubeMap);
+		CHECK(what, layout.subresources.size() == 1);
+		if (layout.subresources.size() == 1)
+		{
+			// Blocks of 4x4 pixels in 16 bytes, right after the header.
+			const DDS::SUBRESOURCE &s = layout.subresources[0];
+			CHECK(what, s.offset == sizeof(uint32_t) + sizeof(DDS::DDS_HEADER));
+			CHECK(what, s.rowBytes == 128 * 16 && s.numRows == 128);
+			CHECK(what, s.sliceBytes == s.rowBytes * s.numRows);
+			CHECK(what, s.offset + s.sliceBytes == file.size());
+		}
+
+		std::vector<uint8_t> broken = file;
+		CHECK(what + " truncated", DDS::Parse(broken.data(), broken.size() - 1, 0, layout) == DDS::RESULT_INVALID);
+		CHECK(what + " header only", DDS::Parse(broken.data(), 100, 0, layout) == DDS::RESULT_INVALID);
+
+		broken[0] = 'X';
+		CHECK(what + " bad magic", DDS::Parse(broken.data(), broken.size(), 0, layout) == DDS::RESULT_INVALID);
+
+		broken = file;
+		header_of(broken)->mipMapCount = 16;
+		CHECK(what + " 16 mips", DDS::Parse(broken.data(), broken.size(), 0, layout) == DDS::RESULT_NOT_SUPPORTED);
+
+		// More mips than the data holds.
+		header_of(broken)->mipMapCount = 2;
+		CHECK(what + " missing mip", DDS::Parse(broken.data(), broken.size(), 0, layout) == DDS::RESULT_INVALID);
+	}
+
+	// A 64x64 BC3 texture with 3 mips, made from the header of a real one.
+	void check_mip_chain(const char *path)
+	{
+		std::string what = std::string(path) + " as 64x64 with 3 mips";
+		std::vector<uint8_t> file;
+		if (!read_file(path, file))
+			return;
+
+		const size_t start = sizeof(uint32_t) + sizeof(DDS::DDS_HEADER);
+		file.resize(start + 4096 + 1024 + 256);
+		auto h = header_of(file);
+		h->width = 64;
+		h->height = 64;
+		h->mipMapCount = 3;
+
+		DDS::LAYOUT layout;
+		CHECK(what, DDS::Parse(file.data(), file.size(), 0, layout) == DDS::RESULT_OK);
+		CHECK(what, layout.mipCount == 3 && layout.subresources.size() == 3);
+		if (layout.subresources.size() == 3)
+		{
+			CHECK(what, layout.subresources[0].offset == start);
+			CHECK(what, layout.subresources[1].offset == start + 4096);
+			CHECK(what, layout.subresources[2].offset == start + 4096 + 1024);
+			CHECK(what, layout.subresources[2].width == 16 && layout.subresources[2].height == 16);
+			CHECK(what, layout.subresources[2].sliceBytes == 256);
+		}
+
+		// maxsize drops the mips above it and starts at the next one.
+		CHECK(what + " maxsize 32", DDS::Parse(file.data(), file.size(), 32, layout) == DDS::RESULT_OK);
+		CHECK(what + " maxsize 32", layout.skipMip == 1 && layout.mipCount == 2 && layout.width == 32);
+		CHECK(what + " maxsize 32", !layout.subresources.empty() && layout.subresources[0].offset == start + 4096);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s file.DDS...\n", argv[0]);
+		return 2;
+	}
+
+	for (int i = 1; i < argc; ++i)
+	{
+		check_game_texture(argv[i]);
+		check_mip_chain(argv[i]);
+	}
+
+	if (failures != 0)
+	{
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	printf("%d files ok\n", argc - 1);
+	return 0;
+}
@@ -0,0 +1,134 @@
+// Writes records of a log_ring with log_file and decodes them back.
+//
+//   log-file-test file.tlog
+//
+// Every decoded record has to match the one written, its text as
+// format_record() gives it on the writing side.  file is left behind for
+// tlog-dump.
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "log_file.h"
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool ok, const std::string &what, const char *expr)
+	{
+		if (ok)
+			return;
+		fprintf(stderr, "FAIL %s: %s\n", what.c_str(), expr);
+		failures++;
+	}
+
+#define CHECK(what, expr) check((expr), (what), #expr)
+
+	struct line
+	{
+		uint64_t time_us;
+		uint32_t thread;
+		trigger::log_severity severity;
+		std::string tag;
+		std::string text;
+	};
+
+	// What went into the ring, in the order it comes out.
+	void fill(trigger::log_ring &ring)
+	{
+		const char *name = "crate";
+		std::string longer(300, 'x');
+		ring.push_deferred(trigger::log_info, "lua", "[log] %s at %.3f, %d of %u", name, 1.25, -3, 7u);
+		ring.push_deferred(trigger::log_warning, "cmd", "key '%c' %5.1f%% %x", 'k', 99.5, 255);
+		ring.push_deferred(trigger::log_error, "", "%s|%g|%e", longer.c_str(), 1e-300, -2.5);
+		ring.push_deferred(trigger::log_info, "lua", "[log] %s at %.3f, %d of %u", "second", -0.5, 0, 0u);
+		ring.push(trigger::log_warning, "world", "formatted %d %s", 42, "already");
+		ring.push_deferred(trigger::log_info, "long tag name", "no arguments");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: %s file.tlog\n", argv[0]);
+		return 2;
+	}
+	const char *path = argv[1];
+
+	trigger::log_ring ring(64);
+	fill(ring);
+
+	std::vector<line> written;
+	{
+		trigger::log_file file;
+		CHECK("open", file.open(path));
+		trigger::log_record r;
+		while (ring.pop(r))
+		{
+			char text[1024];
+			trigger::format_record(r, text, sizeof(text));
+			written.push_back({ r.time_us, r.thread, r.severity, r.tag, text });
+			file.write(r);
+		}
+	}
+	CHECK("records", written.size() == 6);
+
+	std::vector<line> read;
+	bool ok = trigger::log_file::decode(path, [&read](const trigger::log_record &r, const char *text)
+	{
+		read.push_back({ r.time_us, r.thread, r.severity, r.tag, text });
+	});
+	CHECK("decode", ok);
+	CHECK("decode", read.size() == written.size());
+
+	for (size_t i = 0; i < written.size() && i < read.size(); ++i)
+	{
+		std::string what = "record " + std::to_string(i) + " \"" + written[i].text + "\"";
+		CHECK(what, read[i].time_us == written[i].time_us);
+		CHECK(what, read[i].thread == written[i].thread);
+		CHECK(what, read[i].severity == written[i].severity);
+		CHECK(what, read[i].tag == written[i].tag);
+		CHECK(what, read[i].text == written[i].text);
+	}
+	if (written.size() >= 2)
+	{
+		CHECK("string and double", written[0].text == "[log] crate at 1.250, -3 of 7");
+		CHECK("char", written[1].text == "key 'k'  99.5% ff");
+	}
+
+	// Cut anywhere inside the last record, the file must not decode.
+	FILE *in = fopen(path, "rb");
+	std::vector<char> bytes;
+	if (in != nullptr)
+	{
+		char buf[4096];
+		size_t n;
+		while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+			bytes.insert(bytes.end(), buf, buf + n);
+		fclose(in);
+	}
+	std::string cut = std::string(path) + ".cut";
+	FILE *out = fopen(cut.c_str(), "wb");
+	if (out != nullptr && bytes.size() > 3)
+	{
+		fwrite(bytes.data(), 1, bytes.size() - 3, out);
+		fclose(out);
+		size_t decoded = 0;
+		CHECK("truncated", !trigger::log_file::decode(cut.c_str(), [&decoded](const trigger::log_record&, const char*) { decoded++; }));
+		CHECK("truncated", decoded == written.size() - 1);
+	}
+	remove(cut.c_str());
+
+	if (failures != 0)
+	{
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	printf("%d records ok\n", (int)written.size());
+	return 0;
+}
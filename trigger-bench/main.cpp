@@ -0,0 +1,584 @@
+// Headless benchmarks of the engine core: world, fsm, toml, console backend,
+// cvars and, when built with lua, script dispatch.  No window, no D3D12.
+//
+//   trigger-bench [--filter text] [--repeat n] [--scale f]
+//                 [--out file.json] [--compare baseline.json] [--threshold pct]
+//
+// Every scenario runs --repeat times.  The JSON holds one scenario per line,
+// in a fixed order, so that two runs diff and compare line by line.  With
+// --compare the run is checked against a baseline written by --out, and the
+// exit code is 1 when a scenario got slower than --threshold percent.  A
+// scenario that fails is reported, left out of the JSON and exits with 1 too.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "component_world.h"
+#include "log_ring.h"
+#include "command_registry.h"
+#include "cvar.h"
+#include "trigger_clock.h"
+#include "alloc_tracker.h"
+
+#if TRIGGER_BENCH_LUA
+extern "C"
+{
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+}
+#include "lua_allocator.h"
+#endif
+
+namespace
+{
+	// Written by the world scenarios in the working directory, removed at the end.
+	const char *const bench_map = "trigger_bench.map";
+
+	struct result
+	{
+		std::string name;
+		uint64_t ops;			// per run
+		double median_ns;		// per op
+		double min_ns;			// per op
+		double allocs;			// heap allocations per op, of the median run
+		std::string error;		// why it failed, empty when it ran
+	};
+
+	struct options
+	{
+		std::string filter;
+		int repeat = 5;
+		double scale = 1.0;
+		std::string out;
+		std::string compare;
+		double threshold = 10.0;
+	};
+
+	// A scenario sets itself up, then times body and returns how many ops it did.
+	// setup runs before every repetition and is not timed.  Either stops the
+	// scenario with fail().
+	struct scenario
+	{
+		const char *name;
+		std::function<void()> setup;
+		std::function<uint64_t()> body;
+		std::function<void()> teardown;
+	};
+
+	std::string scenario_error;
+
+	uint64_t fail(const std::string &why)
+	{
+		scenario_error = why;
+		return 0;
+	}
+
+	uint64_t total_allocs()
+	{
+		uint64_t n = 0;
+		for (uint32_t t = 0; t < trigger::tag_count; ++t)
+			n += trigger::alloc_tracker::get((trigger::alloc_tag)t).allocs;
+		return n;
+	}
+
+	result run(const scenario &s, int repeat)
+	{
+		struct sample
+		{
+			double ns;
+			uint64_t allocs;
+		};
+		std::vector<sample> samples;
+		uint64_t ops = 0;
+		result r;
+		r.name = s.name;
+		scenario_error.clear();
+		for (int i = 0; i < repeat; ++i)
+		{
+			if (s.setup)
+				s.setup();
+			uint64_t allocs = total_allocs();
+			int64_t begin = trigger::hires_clock::now_ns();
+			if (scenario_error.empty())
+				ops = s.body();
+			int64_t end = trigger::hires_clock::now_ns();
+			allocs = total_allocs() - allocs;
+			if (s.teardown)
+				s.teardown();
+			if (!scenario_error.empty())
+			{
+				r.error = scenario_error;
+				return r;
+			}
+			samples.push_back({ (double)(end - begin), allocs });
+		}
+
+		std::sort(samples.begin(), samples.end(), [](const sample &a, const sample &b) { return a.ns < b.ns; });
+		const sample &median = samples[samples.size() / 2];
+		r.ops = std::max<uint64_t>(ops, 1);
+		r.median_ns = median.ns / r.ops;
+		r.min_ns = samples.front().ns / r.ops;
+		r.allocs = (double)median.allocs / r.ops;
+		return r;
+	}
+
+	uint64_t scaled(const options &o, uint64_t n)
+	{
+		return std::max<uint64_t>((uint64_t)(n * o.scale), 1);
+	}
+
+	// A ring of states after idle, like the actors of a small game: idle
+	// moves to s0 on the first update, then s0 -> s1 -> ... -> s0.
+	std::vector<std::string> build_ring(trigger::fsm::map &m, int states)
+	{
+		std::vector<std::string> names;
+		for (int i = 0; i < states; ++i)
+		{
+			names.push_back("s" + std::to_string(i));
+			if (i != 0)
+				m.add_state(new trigger::fsm::state(names.back()));
+		}
+		for (int i = 0; i < states; ++i)
+			m.link_state(names[i], names[(i + 1) % states]);
+		return names;
+	}
+
+#if TRIGGER_BENCH_LUA
+	// Defines bench(n) with chunk, calls it with n, and closes L.
+	uint64_t run_lua(lua_State *L, const char *chunk, uint64_t n)
+	{
+		if (luaL_dostring(L, chunk) != LUA_OK)
+		{
+			std::string why = lua_tostring(L, -1);
+			lua_close(L);
+			return fail(why);
+		}
+		lua_getglobal(L, "bench");
+		lua_pushinteger(L, (lua_Integer)n);
+		if (lua_pcall(L, 1, 1, 0) != LUA_OK)
+		{
+			std::string why = lua_tostring(L, -1);
+			lua_close(L);
+			return fail(why);
+		}
+		lua_close(L);
+		return n;
+	}
+#endif
+
+	std::vector<scenario> scenarios(const options &o)
+	{
+		std::vector<scenario> list;
+
+		// world --------------------------------------------------------------
+		static trigger::component_world *world = nullptr;
+		auto drop_world = []
+		{
+			delete world;
+			world = nullptr;
+		};
+
+		uint64_t spawn = scaled(o, 100000);
+		list.push_back({ "world.spawn_actors", nullptr, [spawn]
+		{
+			world = new trigger::component_world(false);
+			for (uint64_t i = 0; i < spawn; ++i)
+			{
+				auto a = new trigger::actor();
+				a->name = "actor" + std::to_string(i);
+				world->add(a);
+			}
+			return spawn;
+		}, drop_world });
+
+		uint64_t tick_actors = scaled(o, 10000);
+		uint64_t frames = scaled(o, 1000);
+		list.push_back({ "world.tick_frames", [tick_actors]
+		{
+			world = new trigger::component_world(false);
+			for (uint64_t i = 0; i < tick_actors; ++i)
+				world->add(new trigger::actor());
+		}, [frames, tick_actors]
+		{
+			for (uint64_t f = 0; f < frames; ++f)
+				world->update_all();
+			return frames * tick_actors;
+		}, drop_world });
+
+		// Spawns from the main thread while the world thread ticks, as the
+		// spawns of the scripts do.
+		uint64_t live_spawn = scaled(o, 20000);
+		list.push_back({ "world.spawn_ticking", []
+		{
+			world = new trigger::component_world(true);
+			for (int i = 0; i < 1000; ++i)
+				world->add(new trigger::actor());
+		}, [live_spawn]
+		{
+			for (uint64_t i = 0; i < live_spawn; ++i)
+				world->add(new trigger::actor());
+			if (world->component_count() != 1000 + live_spawn)
+				return fail("spawned actors went missing");
+			return live_spawn;
+		}, drop_world });
+
+		uint64_t map_actors = scaled(o, 10000);
+		auto make_map = [map_actors]
+		{
+			world = new trigger::component_world(false, "bench");
+			for (uint64_t i = 0; i < map_actors; ++i)
+			{
+				auto a = new trigger::actor();
+				a->name = "actor" + std::to_string(i);
+				world->add(a);
+			}
+		};
+
+		list.push_back({ "world.save_map", make_map, [map_actors]
+		{
+			if (!trigger::component_world::save_world(".", bench_map, world))
+				return fail(std::string("can't write ") + bench_map);
+			return map_actors;
+		}, drop_world });
+
+		// Saves a map of its own, so that it runs without world.save_map.
+		list.push_back({ "world.load_map", [make_map, drop_world]
+		{
+			make_map();
+			if (!trigger::component_world::save_world(".", bench_map, world))
+				fail(std::string("can't write ") + bench_map);
+			drop_world();
+		}, [map_actors]
+		{
+			try
+			{
+				world = trigger::component_world::load_world(std::string("./") + bench_map);
+			}
+			catch (const cpptoml::parse_exception &e)
+			{
+				return fail(e.what());
+			}
+			if (world == nullptr)
+				return fail(std::string(bench_map) + " is not a map");
+			return map_actors;
+		}, drop_world });
+
+		// fsm ----------------------------------------------------------------
+		uint64_t churn = scaled(o, 20000);
+		list.push_back({ "fsm.churn", nullptr, [churn]
+		{
+			trigger::fsm::map m;
+			std::vector<trigger::fsm::state*> live;
+			for (uint64_t i = 0; i < churn; ++i)
+			{
+				auto s = new trigger::fsm::state("s" + std::to_string(i));
+				m.add_state(s);
+				if (!live.empty())
+					m.link_state(live.back()->get_name(), s->get_name());
+				live.push_back(s);
+				// Keeps 64 states alive, dropping the oldest with its links.
+				if (live.size() > 64)
+				{
+					m.delete_state(live.front());
+					live.erase(live.begin());
+				}
+			}
+			return churn;
+		}, nullptr });
+
+		uint64_t steps = scaled(o, 1000000);
+		list.push_back({ "fsm.simulate", nullptr, [steps]
+		{
+			// Every step is a transition: the link out of the current state is
+			// armed and the update takes it.
+			trigger::fsm::map m(new trigger::fsm::state("s0"));
+			auto names = build_ring(m, 16);
+			m.update(0.016f);
+			for (uint64_t i = 0; i < steps; ++i)
+			{
+				m.trigger_link(names[i % names.size()], names[(i + 1) % names.size()]);
+				m.update(0.016f);
+			}
+			if (m.get_now_state().get_name() != names[steps % names.size()])
+				return fail("the fsm did not follow its links");
+			return steps;
+		}, nullptr });
+
+		// console backend ----------------------------------------------------
+		uint64_t records = scaled(o, 1000000);
+		list.push_back({ "log.ring_push_pop", nullptr, [records]
+		{
+			trigger::log_ring ring(1024);
+			trigger::log_record r;
+			for (uint64_t i = 0; i < records; ++i)
+			{
+				ring.push_deferred(trigger::log_info, "bench", "[log] frame %d took %.3f ms", (int)i, 16.6);
+				ring.pop(r);
+			}
+			return records;
+		}, nullptr });
+
+		list.push_back({ "log.ring_mpsc", nullptr, [records]
+		{
+			trigger::log_ring ring(1024);
+			const int producers = 4;
+			uint64_t per = records / producers;
+			std::atomic<int> done(0);
+			std::atomic<uint64_t> pushed(0);
+			std::vector<std::thread> threads;
+			for (int p = 0; p < producers; ++p)
+			{
+				threads.emplace_back([&ring, &done, &pushed, per, p]
+				{
+					// A push into a full ring is dropped, and is not an op.
+					uint64_t n = 0;
+					for (uint64_t i = 0; i < per; ++i)
+						n += ring.push_deferred(trigger::log_info, "bench", "[log] %d %d", p, (int)i) ? 1 : 0;
+					pushed.fetch_add(n);
+					done.fetch_add(1);
+				});
+			}
+			// What the console does, draining while the producers run.
+			trigger::log_record r;
+			while (done.load() < producers)
+				ring.pop(r);
+			while (ring.pop(r))
+			{
+			}
+			for (auto &t : threads)
+				t.join();
+			return pushed.load();
+		}, nullptr });
+
+		static trigger::command_registry *commands = nullptr;
+		static uint64_t hits = 0;
+		uint64_t lines = scaled(o, 1000000);
+		list.push_back({ "console.exec", []
+		{
+			commands = new trigger::command_registry();
+			for (int i = 0; i < 500; ++i)
+			{
+				commands->add("cmd" + std::to_string(i) + " sub", "", { { "a", trigger::arg_int, false }, { "b", trigger::arg_float, true } },
+					[](const trigger::command_args &a) { hits += a.get_int(0); });
+			}
+		}, [lines]
+		{
+			std::string error;
+			char line[64];
+			for (uint64_t i = 0; i < lines; ++i)
+			{
+				snprintf(line, sizeof(line), "CMD%d sub %d 1.5", (int)(i % 500), (int)i);
+				commands->exec(line, error);
+			}
+			return lines;
+		}, []
+		{
+			delete commands;
+			commands = nullptr;
+		} });
+
+		list.push_back({ "console.complete", []
+		{
+			commands = new trigger::command_registry();
+			for (int i = 0; i < 500; ++i)
+				commands->add("cmd" + std::to_string(i), "", {}, [](const trigger::command_args&) {});
+		}, [lines]
+		{
+			std::vector<const trigger::command_registry::command*> out;
+			const char *prefixes[] = { "c", "cm", "cmd1", "cmd12", "cmd123", "x" };
+			for (uint64_t i = 0; i < lines; ++i)
+			{
+				const char *p = prefixes[i % 6];
+				commands->complete(p, strlen(p), out, 8);
+			}
+			return lines;
+		}, []
+		{
+			delete commands;
+			commands = nullptr;
+		} });
+
+		// cvars --------------------------------------------------------------
+		static trigger::cvar bench_scale("bench_scale", 1.0f, 0.0f, 16.0f, "", trigger::cvar_none);
+		uint64_t reads = scaled(o, 10000000);
+		list.push_back({ "cvar.read", nullptr, [reads]
+		{
+			float sum = 0.0f;
+			for (uint64_t i = 0; i < reads; ++i)
+				sum += bench_scale.get_float();
+			volatile float keep = sum;
+			(void)keep;
+			return reads;
+		}, nullptr });
+
+#if TRIGGER_BENCH_LUA
+		// lua ----------------------------------------------------------------
+		uint64_t calls = scaled(o, 1000000);
+		list.push_back({ "lua.dispatch", nullptr, [calls]
+		{
+			trigger::lua_allocator memory;
+			lua_State *L = lua_newstate(trigger::lua_allocator::alloc, &memory);
+			luaL_openlibs(L);
+			lua_register(L, "t_add", [](lua_State *L) -> int
+			{
+				lua_pushnumber(L, luaL_checknumber(L, 1) + luaL_checknumber(L, 2));
+				return 1;
+			});
+			return run_lua(L, "function bench(n) local s = 0 for i = 1, n do s = t_add(s, i) end return s end", calls);
+		}, nullptr });
+
+		list.push_back({ "lua.alloc_tables", nullptr, [calls]
+		{
+			trigger::lua_allocator memory;
+			lua_State *L = lua_newstate(trigger::lua_allocator::alloc, &memory);
+			luaL_openlibs(L);
+			return run_lua(L, "function bench(n) local t for i = 1, n do t = { x = i, y = i, z = i } end return t end", calls);
+		}, nullptr });
+#endif
+
+		return list;
+	}
+
+	void write_json(FILE *f, const options &o, const std::vector<result> &results)
+	{
+		fprintf(f, "{\n");
+		fprintf(f, "\"version\": 1,\n");
+		fprintf(f, "\"repeat\": %d,\n", o.repeat);
+		fprintf(f, "\"scale\": %g,\n", o.scale);
+		fprintf(f, "\"results\": [\n");
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const result &r = results[i];
+			fprintf(f, "{\"name\": \"%s\", \"ops\": %llu, \"median_ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, \"allocs_per_op\": %.3f}%s\n",
+				r.name.c_str(), (unsigned long long)r.ops, r.median_ns, r.min_ns, r.allocs, i + 1 < results.size() ? "," : "");
+		}
+		fprintf(f, "]\n}\n");
+	}
+
+	// Reads back what write_json wrote: name -> median ns per op.
+	bool read_baseline(const std::string &path, std::map<std::string, double> &out)
+	{
+		std::ifstream in(path);
+		if (!in.is_open())
+			return false;
+		std::string line;
+		while (std::getline(in, line))
+		{
+			size_t name = line.find("\"name\": \"");
+			size_t median = line.find("\"median_ns_per_op\": ");
+			if (name == std::string::npos || median == std::string::npos)
+				continue;
+			name += 9;
+			size_t end = line.find('"', name);
+			out[line.substr(name, end - name)] = atof(line.c_str() + median + 20);
+		}
+		return true;
+	}
+
+	bool parse_args(int argc, char **argv, options &o)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string a = argv[i];
+			bool has_value = i + 1 < argc;
+			if (a == "--filter" && has_value)
+				o.filter = argv[++i];
+			else if (a == "--repeat" && has_value)
+				o.repeat = std::max<int>(1, atoi(argv[++i]));
+			else if (a == "--scale" && has_value)
+				o.scale = std::max<double>(atof(argv[++i]), 0.0001);
+			else if (a == "--out" && has_value)
+				o.out = argv[++i];
+			else if (a == "--compare" && has_value)
+				o.compare = argv[++i];
+			else if (a == "--threshold" && has_value)
+				o.threshold = atof(argv[++i]);
+			else
+				return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	options o;
+	if (!parse_args(argc, argv, o))
+	{
+		fprintf(stderr, "usage: %s [--filter text] [--repeat n] [--scale f] [--out file.json] [--compare baseline.json] [--threshold pct]\n", argv[0]);
+		return 2;
+	}
+
+	// Read first, a typo should not cost a whole run.
+	std::map<std::string, double> baseline;
+	if (!o.compare.empty() && !read_baseline(o.compare, baseline))
+	{
+		fprintf(stderr, "can't read %s\n", o.compare.c_str());
+		return 2;
+	}
+
+	std::vector<result> results;
+	bool failed = false;
+	for (auto &s : scenarios(o))
+	{
+		if (!o.filter.empty() && strstr(s.name, o.filter.c_str()) == nullptr)
+			continue;
+		result r = run(s, o.repeat);
+		if (!r.error.empty())
+		{
+			fprintf(stderr, "%-22s FAILED: %s\n", r.name.c_str(), r.error.c_str());
+			failed = true;
+			continue;
+		}
+		results.push_back(r);
+		fprintf(stderr, "%-22s %12.1f ns/op  (min %.1f, %.2f allocs/op, %llu ops)\n", r.name.c_str(), r.median_ns, r.min_ns, r.allocs,
+			(unsigned long long)r.ops);
+	}
+	remove(bench_map);
+
+	if (!o.out.empty())
+	{
+		FILE *f = fopen(o.out.c_str(), "w");
+		if (f == nullptr)
+		{
+			fprintf(stderr, "can't write %s\n", o.out.c_str());
+			return 2;
+		}
+		write_json(f, o, results);
+		fclose(f);
+	}
+	else
+	{
+		write_json(stdout, o, results);
+	}
+
+	if (o.compare.empty())
+		return failed ? 1 : 0;
+
+	bool regressed = false;
+	fprintf(stderr, "\n%-22s %12s %12s %9s\n", "scenario", "baseline", "now", "change");
+	for (auto &r : results)
+	{
+		auto found = baseline.find(r.name);
+		if (found == baseline.end() || found->second <= 0.0)
+		{
+			fprintf(stderr, "%-22s %12s %12.1f %9s\n", r.name.c_str(), "-", r.median_ns, "new");
+			continue;
+		}
+		double change = (r.median_ns - found->second) / found->second * 100.0;
+		bool slower = change > o.threshold;
+		regressed = regressed || slower;
+		fprintf(stderr, "%-22s %12.1f %12.1f %+8.1f%%%s\n", r.name.c_str(), found->second, r.median_ns, change, slower ? "  REGRESSION" : "");
+	}
+	return regressed || failed ? 1 : 0;
+}
@@ -0,0 +1,38 @@
+// Prints a binary log captured by log_file as text, one record per line.
+//
+//   tlog-dump file.tlog
+//
+//   time (s)   thread    severity  [tag] text
+//
+// Exits with 1 when the file is not a log or ends early, after printing
+// what could be read.
+
+#include <cstdio>
+
+#include "log_file.h"
+
+int main(int argc, char **argv)
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: %s file.tlog\n", argv[0]);
+		return 2;
+	}
+
+	static const char *severities[] = { "info", "warning", "error" };
+	unsigned long long records = 0;
+	bool ok = trigger::log_file::decode(argv[1], [&records](const trigger::log_record &r, const char *text)
+	{
+		const char *severity = r.severity <= trigger::log_error ? severities[r.severity] : "?";
+		printf("%12.6f %08x %-8s %s%s%s%s\n", r.time_us / 1e6, r.thread, severity,
+			r.tag[0] != 0 ? "[" : "", r.tag, r.tag[0] != 0 ? "] " : "", text);
+		records++;
+	});
+
+	if (!ok)
+	{
+		fprintf(stderr, "%s: not a log file, or it ends early after %llu records\n", argv[1], records);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,323 @@
+#include "AssetUploader.h"
+
+using Microsoft::WRL::ComPtr;
+
+// Staging buffers are rounded up to this so that the pool can reuse them.
+static const UINT64 kStagingGranularity = 64 * 1024;
+
+// Staging memory kept around for reuse once uploads have completed.
+static const UINT64 kMaxPooledStaging = 64 * 1024 * 1024;
+
+AssetUploader::AssetUploader(ID3D12Device* device) : mDevice(device)
+{
+    D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+    queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+    queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    ThrowIfFailed(mDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mCopyQueue)));
+
+    ThrowIfFailed(mDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence)));
+
+    auto alloc = AcquireAllocator();
+    ThrowIfFailed(mDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY,
+        alloc.Get(), nullptr, IID_PPV_ARGS(mCopyList.GetAddressOf())));
+    mCopyList->Close();
+    mAllocatorPool.push_back(alloc);
+
+    mLoader = std::thread(&AssetUploader::LoaderThread, this);
+}
+
+AssetUploader::~AssetUploader()
+{
+    {
+        std::lock_guard<std::mutex> l(mMutex);
+        mQuit = true;
+    }
+    mWake.notify_all();
+    if(mLoader.joinable())
+        mLoader.join();
+
+    // Staging buffers and allocators must outlive the copies still in flight.
+    if(mFence->GetCompletedValue() < mCurrentFence)
+    {
+        HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
+        ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, eventHandle));
+        WaitForSingleObject(eventHandle, INFINITE);
+        CloseHandle(eventHandle);
+    }
+}
+
+ComPtr<ID3D12Resource> AssetUploader::QueueBuffer(const void* data, UINT64 byteSize,
+    std::function<void()> onResident)
+{
+    Request r;
+    ThrowIfFailed(mDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(r.Buffer.GetAddressOf())));
+
+    const BYTE* bytes = reinterpret_cast<const BYTE*>(data);
+    r.Data.assign(bytes, bytes + byteSize);
+    r.OnBufferResident = std::move(onResident);
+
+    ComPtr<ID3D12Resource> buffer = r.Buffer;
+    {
+        std::lock_guard<std::mutex> l(mMutex);
+        mRequests.push_back(std::move(r));
+        ++mPending;
+    }
+    mWake.notify_one();
+
+    return buffer;
+}
+
+void AssetUploader::QueueTexture(const std::wstring& filename, size_t maxsize,
+    std::function<void(ComPtr<ID3D12Resource>)> onResident)
+{
+    Request r;
+    r.Filename = filename;
+    r.MaxSize = maxsize;
+    r.OnTextureResident = std::move(onResident);
+    {
+        std::lock_guard<std::mutex> l(mMutex);
+        mRequests.push_back(std::move(r));
+        ++mPending;
+    }
+    mWake.notify_one();
+}
+
+void AssetUploader::Pump()
+{
+    UINT64 completed = mFence->GetCompletedValue();
+
+    std::vector<Completion> completions;
+    std::vector<Completion> failed;
+    {
+        std::lock_guard<std::mutex> l(mMutex);
+        while(!mInFlight.empty() && mInFlight.front().Fence <= completed)
+        {
+            Batch& b = mInFlight.front();
+            for(auto& s : b.StagingBuffers)
+            {
+                if(mStagingBytes > kMaxPooledStaging)
+                {
+                    mStagingBytes -= s.Size;
+                    continue;
+                }
+                mStagingPool.push_back(std::move(s));
+            }
+            mAllocatorPool.push_back(std::move(b.Allocator));
+
+            mPending -= (UINT)b.Completions.size();
+            for(auto& c : b.Completions)
+                completions.push_back(std::move(c));
+
+            mInFlight.pop_front();
+        }
+
+        mPending -= (UINT)mFailed.size();
+        failed.swap(mFailed);
+    }
+
+    for(auto& c : completions)
+        c(true);
+    for(auto& c : failed)
+        c(false);
+}
+
+UINT AssetUploader::Pending()const
+{
+    std::lock_guard<std::mutex> l(mMutex);
+    return mPending;
+}
+
+UINT64 AssetUploader::StagingBytes()const
+{
+    std::lock_guard<std::mutex> l(mMutex);
+    return mStagingBytes;
+}
+
+void AssetUploader::LoaderThread()
+{
+    for(;;)
+    {
+        std::deque<Request> requests;
+        {
+            std::unique_lock<std::mutex> l(mMutex);
+            mWake.wait(l, [this] { return mQuit || !mRequests.empty(); });
+            if(mQuit)
+                return;
+            requests.swap(mRequests);
+        }
+
+        // Everything that was queued meanwhile goes out in one submission.
+        Batch batch;
+        try
+        {
+            Submit(requests, batch);
+        }
+        catch(DxException& e)
+        {
+            // The copy list or queue failed, which takes the device with it:
+            // nothing of the batch runs, and its resources can go right away.
+            // Either every request is recorded or none is.
+            if(batch.Completions.empty())
+            {
+                for(auto& r : requests)
+                    batch.Completions.push_back(Failed(r, e));
+            }
+            else
+            {
+                OutputDebugStringW((L"AssetUploader: " + e.ToString() + L"\n").c_str());
+            }
+
+            std::lock_guard<std::mutex> l(mMutex);
+            for(auto& c : batch.Completions)
+                mFailed.push_back(std::move(c));
+            continue;
+        }
+
+        std::lock_guard<std::mutex> l(mMutex);
+        mInFlight.push_back(std::move(batch));
+    }
+}
+
+void AssetUploader::Submit(std::deque<Request>& requests, Batch& batch)
+{
+    batch.Allocator = AcquireAllocator();
+    ThrowIfFailed(batch.Allocator->Reset());
+    ThrowIfFailed(mCopyList->Reset(batch.Allocator.Get(), nullptr));
+
+    for(auto& r : requests)
+    {
+        try
+        {
+            Record(r, batch);
+        }
+        catch(DxException& e)
+        {
+            // One bad asset should not take the rest of the batch with it.
+            batch.Completions.push_back(Failed(r, e));
+        }
+    }
+
+    ThrowIfFailed(mCopyList->Close());
+    ID3D12CommandList* cmdsLists[] = { mCopyList.Get() };
+    mCopyQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+    // The fence only advances once signaled, the destructor waits for it.
+    ThrowIfFailed(mCopyQueue->Signal(mFence.Get(), mCurrentFence + 1));
+    batch.Fence = ++mCurrentFence;
+}
+
+AssetUploader::Completion AssetUploader::Failed(Request& request, const DxException& e)
+{
+    OutputDebugStringW((L"AssetUploader: " + e.ToString() + L"\n").c_str());
+
+    if(!request.OnTextureResident)
+        return [](bool) {};
+    auto onResident = std::move(request.OnTextureResident);
+    return [onResident](bool) { onResident(nullptr); };
+}
+
+void AssetUploader::Record(Request& request, Batch& batch)
+{
+    if(request.Buffer != nullptr)
+    {
+        Staging staging = AcquireStaging(request.Data.size());
+
+        BYTE* mapped = nullptr;
+        ThrowIfFailed(staging.Resource->Map(0, nullptr, reinterpret_cast<void**>(&mapped)));
+        memcpy(mapped, request.Data.data(), request.Data.size());
+        staging.Resource->Unmap(0, nullptr);
+
+        mCopyList->CopyBufferRegion(request.Buffer.Get(), 0, staging.Resource.Get(), 0, request.Data.size());
+
+        batch.StagingBuffers.push_back(std::move(staging));
+        // The batch holds the destination too, it must live until the copy is done.
+        ComPtr<ID3D12Resource> buffer = request.Buffer;
+        auto onResident = std::move(request.OnBufferResident);
+        batch.Completions.push_back([onResident, buffer](bool ok) { if(ok && onResident) onResident(); });
+        return;
+    }
+
+    // The file stays mapped only while its texels are written into staging.
+    DirectX::DDSMappedFile file;
+    HRESULT hr = file.Open(request.Filename.c_str(), request.MaxSize);
+    if(FAILED(hr))
+        throw DxException(hr, request.Filename, AnsiToWString(__FILE__), __LINE__);
+
+    ComPtr<ID3D12Resource> texture;
+    ThrowIfFailed(DirectX::CreateDDSTextureFromMappedFile12(mDevice, file, texture));
+
+    const UINT numSubresources = (UINT)file.Layout().subresources.size();
+    Staging staging = AcquireStaging(GetRequiredIntermediateSize(texture.Get(), 0, numSubresources));
+
+    // Some of the copies may be recorded even when this fails, so both stay
+    // with the batch until its fence either way.
+    hr = DirectX::WriteDDSSubresources12(mDevice, mCopyList.Get(), file, texture.Get(), staging.Resource.Get(), 0);
+    batch.StagingBuffers.push_back(std::move(staging));
+    if(FAILED(hr))
+    {
+        batch.Resources.push_back(texture);
+        throw DxException(hr, request.Filename, AnsiToWString(__FILE__), __LINE__);
+    }
+
+    auto onResident = std::move(request.OnTextureResident);
+    batch.Completions.push_back([onResident, texture](bool ok) { onResident(ok ? texture : nullptr); });
+}
+
+AssetUploader::Staging AssetUploader::AcquireStaging(UINT64 byteSize)
+{
+    {
+        // Best fit from the pool.
+        std::lock_guard<std::mutex> l(mMutex);
+        auto best = mStagingPool.end();
+        for(auto it = mStagingPool.begin(); it != mStagingPool.end(); ++it)
+        {
+            if(it->Size >= byteSize && (best == mStagingPool.end() || it->Size < best->Size))
+                best = it;
+        }
+        if(best != mStagingPool.end())
+        {
+            Staging s = std::move(*best);
+            mStagingPool.erase(best);
+            return s;
+        }
+    }
+
+    Staging s;
+    s.Size = (byteSize + kStagingGranularity - 1) & ~(kStagingGranularity - 1);
+    ThrowIfFailed(mDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(s.Size),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(s.Resource.GetAddressOf())));
+
+    std::lock_guard<std::mutex> l(mMutex);
+    mStagingBytes += s.Size;
+    return s;
+}
+
+ComPtr<ID3D12CommandAllocator> AssetUploader::AcquireAllocator()
+{
+    {
+        // Pooled allocators come from completed batches only.
+        std::lock_guard<std::mutex> l(mMutex);
+        if(!mAllocatorPool.empty())
+        {
+            auto alloc = std::move(mAllocatorPool.back());
+            mAllocatorPool.pop_back();
+            return alloc;
+        }
+    }
+
+    ComPtr<ID3D12CommandAllocator> alloc;
+    ThrowIfFailed(mDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+        IID_PPV_ARGS(alloc.GetAddressOf())));
+    return alloc;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "d3dUtil.h"
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+// Streams geometry and textures to default heap resources on a dedicated copy
+// queue.  Files are read and copies recorded on a loader thread, staging
+// buffers are pooled and recycled, and completion is tracked with the copy
+// queue's own fence.  Nothing here blocks the main thread: Pump() is called
+// once per frame and hands finished uploads back through their callbacks.
+//
+// Resources are created in the COMMON state.  The copy queue promotes them to
+// COPY_DEST and they decay back to COMMON when the copy completes, so the
+// graphics queue can use them right away through implicit promotion.
+class AssetUploader
+{
+public:
+    AssetUploader(ID3D12Device* device);
+    AssetUploader(const AssetUploader& rhs) = delete;
+    AssetUploader& operator=(const AssetUploader& rhs) = delete;
+    ~AssetUploader();
+
+    // Creates a default heap buffer and queues the copy of byteSize bytes into it.
+    // The data is copied first, so the caller may free it on return.  The buffer
+    // must not be used by the GPU before onResident has run.  Uploads complete in
+    // the order they were queued, and onResident may be empty.
+    Microsoft::WRL::ComPtr<ID3D12Resource> QueueBuffer(const void* data, UINT64 byteSize,
+        std::function<void()> onResident);
+
+    // Maps a DDS file on the loader thread and uploads it.  Mips larger than
+    // maxsize are left out when maxsize is not 0.  onResident gets the texture
+    // on the main thread, or nullptr when the upload failed.
+    void QueueTexture(const std::wstring& filename, size_t maxsize,
+        std::function<void(Microsoft::WRL::ComPtr<ID3D12Resource>)> onResident);
+
+    // Runs the callbacks of every upload whose copy has completed or failed and
+    // recycles its staging memory.  Call once per frame on the main thread.
+    // Failures are written to the debug output; a failed buffer upload does not
+    // run its callback.
+    void Pump();
+
+    // Number of queued uploads whose callbacks have not run yet.
+    UINT Pending()const;
+
+    UINT64 StagingBytes()const;
+
+private:
+    struct Request
+    {
+        // Buffer upload.
+        Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+        std::vector<BYTE> Data;
+        std::function<void()> OnBufferResident;
+
+        // Texture upload.
+        std::wstring Filename;
+        size_t MaxSize = 0;
+        std::function<void(Microsoft::WRL::ComPtr<ID3D12Resource>)> OnTextureResident;
+    };
+
+    struct Staging
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+        UINT64 Size = 0;
+    };
+
+    // Called on the main thread, with false when the upload failed.
+    typedef std::function<void(bool)> Completion;
+
+    // Uploads submitted together and completed by one fence value.
+    struct Batch
+    {
+        UINT64 Fence = 0;
+        Microsoft::WRL::ComPtr<ID3D12CommandAllocator> Allocator;
+        std::vector<Staging> StagingBuffers;
+        // Destinations of failed requests whose copies may be recorded already.
+        std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> Resources;
+        std::vector<Completion> Completions;
+    };
+
+    void LoaderThread();
+    void Submit(std::deque<Request>& requests, Batch& batch);
+    void Record(Request& request, Batch& batch);
+    static Completion Failed(Request& request, const DxException& e);
+    Staging AcquireStaging(UINT64 byteSize);
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> AcquireAllocator();
+
+    ID3D12Device* mDevice = nullptr;
+
+    Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCopyQueue;
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCopyList;
+    Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+    UINT64 mCurrentFence = 0;
+
+    std::thread mLoader;
+    bool mQuit = false;
+
+    // Guards everything below.
+    mutable std::mutex mMutex;
+    std::condition_variable mWake;
+
+    std::deque<Request> mRequests;
+    std::deque<Batch> mInFlight;
+    std::vector<Staging> mStagingPool;
+    std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> mAllocatorPool;
+    UINT mPending = 0;
+    UINT64 mStagingBytes = 0;
+    // Uploads of batches that never made it to the copy queue.
+    std::vector<Completion> mFailed;
+};
@@ -4,11 +4,15 @@
 
 #include "d3dApp.h"
 #include "MathHelper.h"
-#include "UploadBuffer.h"
+#include "UploadRing.h"
+#include "AssetUploader.h"
+#include "TextureStreamer.h"
 #include "GeometryGenerator.h"
 #include "FrameResource.h"
 
 #include "trigger_lua.h"
+#include "cvar.h"
+#include <condition_variable>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -17,7 +21,25 @@ using namespace DirectX::PackedVector;
 #pragma comment(lib, "d3dcompiler.lib")
 #pragma comment(lib, "D3D12.lib")
 
-const int gNumFrameResources = 3;
+// Set from r_frame_resources before anything is built.
+int gNumFrameResources = 3;
+
+// Upper bound of threads recording scene command lists in parallel.
+const int gMaxRecordWorkers = 8;
+
+// Initial size of the upload ring holding per-frame constants.  It grows on demand.
+const UINT64 gUploadRingSize = 4 * 1024 * 1024;
+
+// Tunables, set from the console ("set name value") and kept in trigger.toml.
+static trigger::cvar gFrameResources("r_frame_resources", 3, 2, 8,
+	"frames the cpu may run ahead of the gpu", trigger::cvar_save | trigger::cvar_restart);
+static trigger::cvar gRecordWorkers("r_record_workers", 0, 0, gMaxRecordWorkers,
+	"threads recording the scene, 0 for one per core but the main one", trigger::cvar_save | trigger::cvar_restart);
+static trigger::cvar gParallelRecord("r_parallel_record", true, "records the scene on the worker threads");
+static trigger::cvar gTextureBudgetMB("r_texture_budget_mb", 64, 1, 4096, "video memory for streamed texture mips");
+static trigger::cvar gAmbientScale("r_ambient_scale", 1.0f, 0.0f, 4.0f, "scales the ambient light");
+static trigger::cvar gLightScale("r_light_scale", 1.0f, 0.0f, 4.0f, "scales the directional lights");
+static trigger::cvar gConsoleHeight("ui_console_height", 232, 64, 1024, "height of the console window");
 
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
@@ -32,13 +54,8 @@ struct RenderItem
 
 	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
-
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
+	// Index into this frame's ObjectCB block corresponding to this render item.
+	// Object constants are transient and rewritten every frame, so there is no dirty flag.
 	UINT ObjCBIndex = -1;
 
 	Material* Mat = nullptr;
@@ -91,7 +108,17 @@ private:
 	void BuildFrameResources();
 	void BuildMaterials();
 	void BuildRenderItems();
-	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	void BuildRecordWorkers();
+	void BuildTextureStreamer();
+	void UpdateTextureDemand();
+	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems, size_t begin, size_t end);
+	void DrawGui(ID3D12GraphicsCommandList* cmdList);
+	void RegisterCommands();
+
+	// Parallel scene recording.  Each worker records [begin, end) of mOpaqueRitems
+	// into its own command list, using its own allocator of the current FrameResource.
+	void RecordWorker(UINT index);
+	void RecordSceneRange(UINT index);
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
 
@@ -100,6 +127,20 @@ private:
 	FrameResource* mCurrFrameResource = nullptr;
 	int mCurrFrameResourceIndex = 0;
 
+	// Transient per-frame constants of every FrameResource live here.
+	std::unique_ptr<UploadRing> mUploadRing;
+
+	// Streams geometry and textures in on the copy queue after startup.
+	std::unique_ptr<AssetUploader> mUploader;
+
+	// Keeps texture mips resident by distance to the camera.  SRV heap slot 0 is
+	// ImGui's font, the rest belong to the streamer.
+	std::unique_ptr<TextureStreamer> mStreamer;
+
+	// Not in any world: the target when nothing is selected, and the actor
+	// scripts attach to by default.
+	std::unique_ptr<trigger::actor> mSpareTarget;
+
 	UINT mCbvSrvDescriptorSize = 0;
 
 	ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
@@ -123,6 +164,24 @@ private:
 
 	PassConstants mMainPassCB;
 
+	// Scene command lists, one per recording worker.  mCommandList records the frame
+	// setup and mGuiCommandList records ImGui, so a frame is submitted as
+	// { mCommandList, mWorkerCmdLists..., mGuiCommandList }.
+	UINT mNumRecordWorkers = 1;
+	std::vector<ComPtr<ID3D12GraphicsCommandList>> mWorkerCmdLists;
+	ComPtr<ID3D12GraphicsCommandList> mGuiCommandList = nullptr;
+	std::vector<std::thread> mRecordThreads;
+	std::mutex mRecordMutex;
+	std::condition_variable mRecordBegin;
+	std::condition_variable mRecordDone;
+	UINT64 mRecordFrame = 0;
+	UINT mRecordPending = 0;
+	bool mRecordQuit = false;
+	uint32_t mTextureBudgetVersion = 0;
+
+	// CPU time spent recording command lists, in ms.  Smoothed over frames.
+	float mRecordCpuMs = 0.0f;
+
 	XMFLOAT3 mEyePos = { 0.0f, 0.0f, 0.0f };
 	XMFLOAT4X4 mView = MathHelper::Identity4x4();
 	XMFLOAT4X4 mProj = MathHelper::Identity4x4();
@@ -170,12 +229,29 @@ CrateApp::CrateApp(HINSTANCE hInstance)
 
 CrateApp::~CrateApp()
 {
+	{
+		std::lock_guard<std::mutex> l(mRecordMutex);
+		mRecordQuit = true;
+	}
+	mRecordBegin.notify_all();
+	for (auto& t : mRecordThreads)
+	{
+		if (t.joinable()) t.join();
+	}
+	trigger::tlua::shutdown();
+	trigger::cvars::save(trigger::cvar_config);
+
 	if (md3dDevice != nullptr)
 		FlushCommandQueue();
 }
 
 bool CrateApp::Initialize()
 {
+	// Before anything reads a cvar.  No config yet is fine, they keep their defaults.
+	std::string cvarError;
+	bool cvarsLoaded = trigger::cvars::load(trigger::cvar_config, cvarError);
+	gNumFrameResources = gFrameResources.get_int();
+
 	if (!D3DApp::Initialize())
 		return false;
 
@@ -204,26 +280,35 @@ bool CrateApp::Initialize()
 	scale[1] = 0;
 	scale[2] = 0;
 	cam.SetOrthographic(false);
-	target = new trigger::actor();
+	mSpareTarget = std::make_unique<trigger::actor>();
+	target = mSpareTarget.get();
 	console = new trigger::ui::console(selected_world);
+	if (!cvarsLoaded)
+		console->AddLog("[log] %s, cvars at their defaults", cvarError.c_str());
 	//mEyePos = XMFLOAT3(1, 1, 1);
 	cam.SetLens(0.6f * MathHelper::Pi, 1.833f, 0.00001f, 1000.0f);
 
 	//test lua
 	trigger::tlua::init(console,this->selected_world, this->target);
+	RegisterCommands();
 	trigger::tlua::run("lua/test_actor.lua");
 
+	mUploader = std::make_unique<AssetUploader>(md3dDevice.Get());
+
 	LoadTextures();
 	BuildRootSignature();
 	BuildDescriptorHeaps();
+	BuildTextureStreamer();
 	BuildShadersAndInputLayout();
 	BuildShapeGeometry();
 	BuildMaterials();
 	BuildRenderItems();
 	BuildFrameResources();
 	BuildPSOs();
+	BuildRecordWorkers();
 
-	// Execute the initialization commands.
+	// Execute the initialization commands.  Assets are not part of them any more,
+	// they keep streaming in on the copy queue while the first frames render.
 	ThrowIfFailed(mCommandList->Close());
 	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
 	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
@@ -245,6 +330,7 @@ void CrateApp::OnResize()
 float tick;
 void CrateApp::Update(const GameTimer& gt)
 {
+	TRIGGER_PROFILE_SCOPE("CrateApp::Update");
 	UpdateCamera(gt);
 
 	// Cycle through the circular frame resource array.
@@ -260,6 +346,17 @@ void CrateApp::Update(const GameTimer& gt)
 		WaitForSingleObject(eventHandle, INFINITE);
 		CloseHandle(eventHandle);
 	}
+	mUploadRing->Reclaim(mFence->GetCompletedValue());
+
+	// Residency changes are queued before Pump so that finished ones swap in this frame.
+	if (gTextureBudgetMB.version() != mTextureBudgetVersion)
+	{
+		mTextureBudgetVersion = gTextureBudgetMB.version();
+		mStreamer->SetBudget((UINT64)gTextureBudgetMB.get_int() * 1024 * 1024);
+	}
+	UpdateTextureDemand();
+	mStreamer->Update(mFence->GetCompletedValue(), mCurrentFence);
+	mUploader->Pump();
 
 	AnimateMaterials(gt);
 	UpdateObjectCBs(gt);
@@ -267,24 +364,26 @@ void CrateApp::Update(const GameTimer& gt)
 	UpdateMainPassCB(gt);
 
 
-	trigger::tlua::_load_update_func(gt.DeltaTime());
+	// Scripts run while the frame is recorded, their changes land in Draw.
+	trigger::tlua::kick(gt.DeltaTime());
 }
 
 
 void CrateApp::Draw(const GameTimer& gt)
 {
-	auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
+	TRIGGER_PROFILE_SCOPE("CrateApp::Draw");
+	trigger::alloc_scope heap(trigger::tag_render);
+	int64_t recordStart = trigger::hires_clock::now_ns();
 
 	// Reuse the memory associated with command recording.
 	// We can only reset when the associated command lists have finished execution on the GPU.
-	ThrowIfFailed(cmdListAlloc->Reset());
+	ThrowIfFailed(mCurrFrameResource->CmdListAlloc->Reset());
+	for (auto& alloc : mCurrFrameResource->WorkerCmdListAllocs)
+		ThrowIfFailed(alloc->Reset());
 
 	// A command list can be reset after it has been added to the command queue via ExecuteCommandList.
 	// Reusing the command list reuses memory.
-	ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mOpaquePSO.Get()));
-
-	mCommandList->RSSetViewports(1, &mScreenViewport);
-	mCommandList->RSSetScissorRects(1, &mScissorRect);
+	ThrowIfFailed(mCommandList->Reset(mCurrFrameResource->CmdListAlloc.Get(), mOpaquePSO.Get()));
 
 	// Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -294,29 +393,61 @@ void CrateApp::Draw(const GameTimer& gt)
 	mCommandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::LightSteelBlue, 0, nullptr);
 	mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 
-	// Specify the buffers we are going to render to.
-	mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
+	ThrowIfFailed(mCommandList->Close());
 
-	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
-	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+	// Kick the workers.  The setup list is closed, so the shared allocator is free
+	// for the gui list which we record on this thread meanwhile.  The gui may flip
+	// r_parallel_record, so latch it for this frame.
+	const bool parallel = gParallelRecord.get_bool();
+	if (parallel)
+	{
+		{
+			std::lock_guard<std::mutex> l(mRecordMutex);
+			mRecordPending = mNumRecordWorkers;
+			++mRecordFrame;
+		}
+		mRecordBegin.notify_all();
+	}
+	else
+	{
+		for (UINT i = 0; i < mNumRecordWorkers; ++i)
+			RecordSceneRange(i);
+	}
 
-	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+	ThrowIfFailed(mGuiCommandList->Reset(mCurrFrameResource->CmdListAlloc.Get(), nullptr));
+	mGuiCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
 
-	auto passCB = mCurrFrameResource->PassCB->Resource();
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+	mGuiCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 
-	DrawRenderItems(mCommandList.Get(), mOpaqueRitems);
+	trigger::tlua::sync();
+	DrawGui(mGuiCommandList.Get());
 
 	// Indicate a state transition on the resource usage.
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
+	mGuiCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
 		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
 
 	// Done recording commands.
-	ThrowIfFailed(mCommandList->Close());
+	ThrowIfFailed(mGuiCommandList->Close());
 
-	// Add the command list to the queue for execution.
-	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	if (parallel)
+	{
+		std::unique_lock<std::mutex> l(mRecordMutex);
+		mRecordDone.wait(l, [this] { return mRecordPending == 0; });
+	}
+
+	// Add the command lists to the queue for execution, in recording order.
+	ID3D12CommandList* cmdsLists[gMaxRecordWorkers + 2];
+	UINT numLists = 0;
+	cmdsLists[numLists++] = mCommandList.Get();
+	for (UINT i = 0; i < mNumRecordWorkers; ++i)
+		cmdsLists[numLists++] = mWorkerCmdLists[i].Get();
+	cmdsLists[numLists++] = mGuiCommandList.Get();
+
+	float recordMs = (trigger::hires_clock::now_ns() - recordStart) * 1e-6f;
+	mRecordCpuMs = mRecordCpuMs * 0.95f + recordMs * 0.05f;
+
+	mCommandQueue->ExecuteCommandLists(numLists, cmdsLists);
 
 	// Swap the back and front buffers
 	ThrowIfFailed(mSwapChain->Present(0, 0));
@@ -324,11 +455,70 @@ void CrateApp::Draw(const GameTimer& gt)
 
 	// Advance the fence value to mark commands up to this fence point.
 	mCurrFrameResource->Fence = ++mCurrentFence;
+	mUploadRing->FinishFrame(mCurrentFence);
 
 	// Add an instruction to the command queue to set a new fence point. 
 	// Because we are on the GPU timeline, the new fence point won't be 
 	// set until the GPU finishes processing all the commands prior to this Signal().
 	mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+
+	// The frame is submitted, the GPU is busy with it: collect lua garbage now
+	// rather than in the middle of the scripts' update.
+	trigger::tlua::gc_step();
+}
+
+void CrateApp::RecordWorker(UINT index)
+{
+	TRIGGER_PROFILE_THREAD("record");
+	UINT64 recorded = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> l(mRecordMutex);
+			mRecordBegin.wait(l, [&] { return mRecordQuit || mRecordFrame != recorded; });
+			if (mRecordQuit)
+				return;
+			recorded = mRecordFrame;
+		}
+
+		RecordSceneRange(index);
+
+		bool last = false;
+		{
+			std::lock_guard<std::mutex> l(mRecordMutex);
+			last = (--mRecordPending == 0);
+		}
+		if (last)
+			mRecordDone.notify_one();
+	}
+}
+
+void CrateApp::RecordSceneRange(UINT index)
+{
+	TRIGGER_PROFILE_SCOPE("CrateApp::RecordSceneRange");
+	auto cmdList = mWorkerCmdLists[index].Get();
+	ThrowIfFailed(cmdList->Reset(mCurrFrameResource->WorkerCmdListAllocs[index].Get(), mOpaquePSO.Get()));
+
+	// Command lists do not inherit state, so every worker sets up the pass itself.
+	cmdList->RSSetViewports(1, &mScreenViewport);
+	cmdList->RSSetScissorRects(1, &mScissorRect);
+	cmdList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
+
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+	cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+	cmdList->SetGraphicsRootSignature(mRootSignature.Get());
+
+	cmdList->SetGraphicsRootConstantBufferView(2, mCurrFrameResource->PassCB);
+
+	// Split the render items into even contiguous ranges.
+	size_t count = mOpaqueRitems.size();
+	size_t chunk = (count + mNumRecordWorkers - 1) / mNumRecordWorkers;
+	size_t begin = std::min<size_t>(count, index * chunk);
+	size_t end = std::min<size_t>(count, begin + chunk);
+	DrawRenderItems(cmdList, mOpaqueRitems, begin, end);
+
+	ThrowIfFailed(cmdList->Close());
 }
 
 void CrateApp::OnMouseDown(WPARAM btnState, int x, int y)
@@ -474,59 +664,50 @@ void CrateApp::AnimateMaterials(const GameTimer& gt)
 
 void CrateApp::UpdateObjectCBs(const GameTimer& gt)
 {
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
+	TRIGGER_PROFILE_SCOPE("CrateApp::UpdateObjectCBs");
+	// One block for every object this frame.  The block is transient, so every
+	// element is rewritten each frame and the object count can change freely.
+	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+	auto block = mUploadRing->AllocateConstants<ObjectConstants>((UINT)mAllRitems.size());
+	mCurrFrameResource->ObjectCB = block.GPU;
+
 	XMMATRIX world = XMMatrixIdentity();
 	XMMATRIX texTransform = XMMatrixIdentity();
 	for (auto& e : mAllRitems)
 	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if (e->NumFramesDirty > 0)
-		{
-			world = world * XMLoadFloat4x4(&e->World);
-			texTransform = world * XMLoadFloat4x4(&e->TexTransform);
-
-			ObjectConstants objConstants;
-			XMMATRIX x = XMMatrixRotationX(target->s_transform.rotation.x);
-			XMMATRIX y = XMMatrixRotationY(target->s_transform.rotation.y);
-			XMMATRIX z = XMMatrixRotationZ(target->s_transform.rotation.z);
+		world = world * XMLoadFloat4x4(&e->World);
+		texTransform = world * XMLoadFloat4x4(&e->TexTransform);
 
-			XMMATRIX s = XMMatrixScaling(target->s_transform.scale.x, target->s_transform.scale.y, target->s_transform.scale.z);
+		XMMATRIX x = XMMatrixRotationX(target->s_transform.rotation.x);
+		XMMATRIX y = XMMatrixRotationY(target->s_transform.rotation.y);
+		XMMATRIX z = XMMatrixRotationZ(target->s_transform.rotation.z);
 
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world * s * (x * y * z) * (XMMatrixTranslation(target->s_transform.position.x, target->s_transform.position.y, target->s_transform.position.z))));
-			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+		XMMATRIX s = XMMatrixScaling(target->s_transform.scale.x, target->s_transform.scale.y, target->s_transform.scale.z);
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
-
-			// Next FrameResource need to be updated too.
-			//e->NumFramesDirty--;
-		}
+		// Write straight into the mapped (write-combined) heap, front to back.
+		ObjectConstants* objConstants = reinterpret_cast<ObjectConstants*>(block.CPU + e->ObjCBIndex*objCBByteSize);
+		XMStoreFloat4x4(&objConstants->World, XMMatrixTranspose(world * s * (x * y * z) * (XMMatrixTranslation(target->s_transform.position.x, target->s_transform.position.y, target->s_transform.position.z))));
+		XMStoreFloat4x4(&objConstants->TexTransform, XMMatrixTranspose(texTransform));
+		objConstants->opacity = 1.0f;
 	}
 }
 
 void CrateApp::UpdateMaterialCBs(const GameTimer& gt)
 {
-	auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
+	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+	auto block = mUploadRing->AllocateConstants<MaterialConstants>((UINT)mMaterials.size());
+	mCurrFrameResource->MaterialCB = block.GPU;
+
 	for (auto& e : mMaterials)
 	{
-		// Only update the cbuffer data if the constants have changed.  If the cbuffer
-		// data changes, it needs to be updated for each FrameResource.
 		Material* mat = e.second.get();
-		if (mat->NumFramesDirty > 0)
-		{
-			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
-
-			MaterialConstants matConstants;
-			matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
-			matConstants.FresnelR0 = mat->FresnelR0;
-			matConstants.Roughness = mat->Roughness;
-			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
-
-			currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
+		XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
 
-			// Next FrameResource need to be updated too.
-			mat->NumFramesDirty--;
-		}
+		MaterialConstants* matConstants = reinterpret_cast<MaterialConstants*>(block.CPU + mat->MatCBIndex*matCBByteSize);
+		matConstants->DiffuseAlbedo = mat->DiffuseAlbedo;
+		matConstants->FresnelR0 = mat->FresnelR0;
+		matConstants->Roughness = mat->Roughness;
+		XMStoreFloat4x4(&matConstants->MatTransform, XMMatrixTranspose(matTransform));
 	}
 }
 
@@ -553,46 +734,46 @@ void CrateApp::UpdateMainPassCB(const GameTimer& gt)
 	mMainPassCB.FarZ = 1000.0f;
 	mMainPassCB.TotalTime = gt.TotalTime();
 	mMainPassCB.DeltaTime = gt.DeltaTime();
-	mMainPassCB.AmbientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
+	float ambient = gAmbientScale.get_float();
+	float light = gLightScale.get_float();
+	mMainPassCB.AmbientLight = { 0.25f * ambient, 0.25f * ambient, 0.35f * ambient, 1.0f };
 	mMainPassCB.Lights[0].Direction = { 0.57735f, -0.57735f, 0.57735f };
-	mMainPassCB.Lights[0].Strength = { 0.6f, 0.6f, 0.6f };
+	mMainPassCB.Lights[0].Strength = { 0.6f * light, 0.6f * light, 0.6f * light };
 	mMainPassCB.Lights[1].Direction = { -0.57735f, -0.57735f, 0.57735f };
-	mMainPassCB.Lights[1].Strength = { 0.3f, 0.3f, 0.3f };
+	mMainPassCB.Lights[1].Strength = { 0.3f * light, 0.3f * light, 0.3f * light };
 	mMainPassCB.Lights[2].Direction = { 0.0f, -0.707f, -0.707f };
-	mMainPassCB.Lights[2].Strength = { 0.15f, 0.15f, 0.15f };
+	mMainPassCB.Lights[2].Strength = { 0.15f * light, 0.15f * light, 0.15f * light };
 
-	auto currPassCB = mCurrFrameResource->PassCB.get();
-	currPassCB->CopyData(0, mMainPassCB);
+	auto block = mUploadRing->AllocateConstants<PassConstants>(1);
+	memcpy(block.CPU, &mMainPassCB, sizeof(PassConstants));
+	mCurrFrameResource->PassCB = block.GPU;
 }
 
 
 
 void CrateApp::LoadTextures()
 {
-	auto woodCrateTex = std::make_unique<Texture>();
-	woodCrateTex->Name = "woodCrateTex";
-	woodCrateTex->Filename = L"../tools/ui_heart_dot.DDS";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), woodCrateTex->Filename.c_str(),
-		woodCrateTex->Resource, woodCrateTex->UploadHeap));
-
-	auto woodCrateTex1 = std::make_unique<Texture>();
-	woodCrateTex1->Name = "woodCrateTex1";
-	woodCrateTex1->Filename = L"../tools/512_untitled_texture.DDS";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), woodCrateTex1->Filename.c_str(),
-		woodCrateTex1->Resource, woodCrateTex1->UploadHeap));
-
-	auto woodCrateTex2 = std::make_unique<Texture>();
-	woodCrateTex2->Name = "woodCrateTex2";
-	woodCrateTex2->Filename = L"../tools/512_untitled_texture.DDS";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), woodCrateTex2->Filename.c_str(),
-		woodCrateTex2->Resource, woodCrateTex2->UploadHeap));
-
-	mTextures[woodCrateTex->Name] = std::move(woodCrateTex);
-	mTextures[woodCrateTex1->Name] = std::move(woodCrateTex1);
-	mTextures[woodCrateTex2->Name] = std::move(woodCrateTex2);
+	struct TextureFile
+	{
+		const char* Name;
+		const wchar_t* Filename;
+	};
+
+	const TextureFile files[] =
+	{
+		{ "woodCrateTex", L"../tools/ui_heart_dot.DDS" },
+		{ "woodCrateTex1", L"../tools/512_untitled_texture.DDS" },
+		{ "woodCrateTex2", L"../tools/512_untitled_texture.DDS" },
+	};
+
+	// The texels are streamed in by BuildTextureStreamer.
+	for (auto& f : files)
+	{
+		auto tex = std::make_unique<Texture>();
+		tex->Name = f.Name;
+		tex->Filename = f.Filename;
+		mTextures[tex->Name] = std::move(tex);
+	}
 }
 
 void CrateApp::BuildRootSignature()
@@ -641,13 +822,11 @@ void CrateApp::BuildDescriptorHeaps()
 	// Create the SRV heap.
 	//
 	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-	srvHeapDesc.NumDescriptors = 4;
+	srvHeapDesc.NumDescriptors = 1 + 2 * (UINT)mTextures.size();
 	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
 	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
 	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
 
-	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
-
 	{
 		IMGUI_CHECKVERSION();
 		ImGui::CreateContext();
@@ -657,45 +836,44 @@ void CrateApp::BuildDescriptorHeaps()
 			mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(),
 			mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 	}
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-	{
-		auto woodCrateTex = mTextures["woodCrateTex"]->Resource;
-		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.Format = woodCrateTex->GetDesc().Format;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-		srvDesc.Texture2D.MostDetailedMip = 0;
-		srvDesc.Texture2D.MipLevels = woodCrateTex->GetDesc().MipLevels;
-		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-		md3dDevice->CreateShaderResourceView(woodCrateTex.Get(), &srvDesc, hDescriptor);
-	}
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-	{
-		auto woodCrateTex = mTextures["woodCrateTex1"]->Resource;
-		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.Format = woodCrateTex->GetDesc().Format;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-		srvDesc.Texture2D.MostDetailedMip = 0;
-		srvDesc.Texture2D.MipLevels = woodCrateTex->GetDesc().MipLevels;
-		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-		md3dDevice->CreateShaderResourceView(woodCrateTex.Get(), &srvDesc, hDescriptor);
-	}
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+
+	// The texture SRVs are written by the TextureStreamer as mips arrive.
+}
+
+void CrateApp::BuildTextureStreamer()
+{
+	mStreamer = std::make_unique<TextureStreamer>(md3dDevice.Get(), mUploader.get(),
+		mSrvDescriptorHeap.Get(), 1, (UINT)mTextures.size(), (UINT64)gTextureBudgetMB.get_int() * 1024 * 1024);
+	mTextureBudgetVersion = gTextureBudgetMB.version();
+
+	for (auto& e : mTextures)
+		mStreamer->Add(e.second.get());
+}
+
+void CrateApp::UpdateTextureDemand()
+{
+	// Every render item is placed by the target's transform on unit geometry,
+	// so its bounding radius is the largest scale.
+	XMFLOAT3 eye = cam.GetPosition3f();
+	auto& tr = target->s_transform;
+	float radius = std::max<float>(std::max<float>(fabsf(tr.scale.x), fabsf(tr.scale.y)), fabsf(tr.scale.z));
+	float dx = tr.position.x - eye.x;
+	float dy = tr.position.y - eye.y;
+	float dz = tr.position.z - eye.z;
+	float dist = sqrtf(dx*dx + dy*dy + dz*dz);
+
+	// Height in pixels covered by the object on screen.
+	float pixels = (dist <= radius) ? (float)mClientHeight :
+		radius * mClientHeight / (dist * tanf(0.5f * cam.GetFovY()));
+
+	for (auto ri : mOpaqueRitems)
 	{
-		auto woodCrateTex = mTextures["woodCrateTex2"]->Resource;
-		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.Format = woodCrateTex->GetDesc().Format;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-		srvDesc.Texture2D.MostDetailedMip = 0;
-		srvDesc.Texture2D.MipLevels = woodCrateTex->GetDesc().MipLevels;
-		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-		md3dDevice->CreateShaderResourceView(woodCrateTex.Get(), &srvDesc, hDescriptor);
+		Texture* tex = ri->Mat->DiffuseMap;
+		if (tex != nullptr && tex->MipCount != 0)
+			mStreamer->Request(tex, TextureStreamer::DemandMip(*tex, pixels));
 	}
 }
 
-
 void CrateApp::BuildShadersAndInputLayout()
 {
 	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_0");
@@ -743,11 +921,11 @@ void CrateApp::BuildShapeGeometry()
 		ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 		CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-		geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-			mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-		geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-			mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		// Uploads complete in order, so the index buffer arriving means both did.
+		MeshGeometry* g = geo.get();
+		g->Resident = false;
+		geo->VertexBufferGPU = mUploader->QueueBuffer(vertices.data(), vbByteSize, nullptr);
+		geo->IndexBufferGPU = mUploader->QueueBuffer(indices.data(), ibByteSize, [g]() { g->Resident = true; });
 
 		geo->VertexByteStride = sizeof(Vertex);
 		geo->VertexBufferByteSize = vbByteSize;
@@ -790,11 +968,11 @@ void CrateApp::BuildShapeGeometry()
 		ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 		CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-		geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-			mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-		geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-			mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		// Uploads complete in order, so the index buffer arriving means both did.
+		MeshGeometry* g = geo.get();
+		g->Resident = false;
+		geo->VertexBufferGPU = mUploader->QueueBuffer(vertices.data(), vbByteSize, nullptr);
+		geo->IndexBufferGPU = mUploader->QueueBuffer(indices.data(), ibByteSize, [g]() { g->Resident = true; });
 
 		geo->VertexByteStride = sizeof(Vertex);
 		geo->VertexBufferByteSize = vbByteSize;
@@ -856,11 +1034,38 @@ void CrateApp::BuildPSOs()
 
 void CrateApp::BuildFrameResources()
 {
+	// Leave one core for the main thread, which records the gui meanwhile.
+	int cores = (int)std::thread::hardware_concurrency();
+	int workers = gRecordWorkers.get_int() != 0 ? gRecordWorkers.get_int() : cores - 1;
+	mNumRecordWorkers = (UINT)std::max<int>(1, std::min<int>(gMaxRecordWorkers, workers));
+
 	for (int i = 0; i < gNumFrameResources; ++i)
 	{
-		mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-			1, (UINT)mAllRitems.size(), (UINT)mMaterials.size()));
+		mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(), mNumRecordWorkers));
 	}
+
+	mUploadRing = std::make_unique<UploadRing>(md3dDevice.Get(), gUploadRingSize);
+}
+
+void CrateApp::BuildRecordWorkers()
+{
+	auto alloc = mFrameResources[0]->CmdListAlloc.Get();
+
+	mWorkerCmdLists.resize(mNumRecordWorkers);
+	for (UINT i = 0; i < mNumRecordWorkers; ++i)
+	{
+		ThrowIfFailed(md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+			mFrameResources[0]->WorkerCmdListAllocs[i].Get(), nullptr,
+			IID_PPV_ARGS(mWorkerCmdLists[i].GetAddressOf())));
+		mWorkerCmdLists[i]->Close();
+	}
+
+	ThrowIfFailed(md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+		alloc, nullptr, IID_PPV_ARGS(mGuiCommandList.GetAddressOf())));
+	mGuiCommandList->Close();
+
+	for (UINT i = 0; i < mNumRecordWorkers; ++i)
+		mRecordThreads.emplace_back(&CrateApp::RecordWorker, this, i);
 }
 
 void CrateApp::BuildMaterials()
@@ -869,6 +1074,7 @@ void CrateApp::BuildMaterials()
 		auto woodCrate = std::make_unique<Material>();
 		woodCrate->Name = "woodCrate";
 		woodCrate->MatCBIndex = 0;
+		woodCrate->DiffuseMap = mTextures["woodCrateTex"].get();
 		woodCrate->DiffuseSrvHeapIndex = 1; // <- ̰  ImGui  Ҵ ѹ ϴϱ +1  .
 		woodCrate->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
 		woodCrate->FresnelR0 = XMFLOAT3(0.05f, 0.05f, 0.05f);
@@ -881,6 +1087,7 @@ void CrateApp::BuildMaterials()
 		auto woodCrate = std::make_unique<Material>();
 		woodCrate->Name = "woodCrate2";
 		woodCrate->MatCBIndex = 0;
+		woodCrate->DiffuseMap = mTextures["woodCrateTex1"].get();
 		woodCrate->DiffuseSrvHeapIndex = 2;
 		woodCrate->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
 		woodCrate->FresnelR0 = XMFLOAT3(0.05f, 0.05f, 0.05f);
@@ -893,6 +1100,7 @@ void CrateApp::BuildMaterials()
 		auto woodCrate = std::make_unique<Material>();
 		woodCrate->Name = "woodCrate3";
 		woodCrate->MatCBIndex = 0;
+		woodCrate->DiffuseMap = mTextures["woodCrateTex2"].get();
 		woodCrate->DiffuseSrvHeapIndex = 3;
 		woodCrate->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
 		woodCrate->FresnelR0 = XMFLOAT3(0.05f, 0.05f, 0.05f);
@@ -962,28 +1170,31 @@ void CrateApp::BuildRenderItems()
 void CrateApp::BuildProperty(trigger::component * comp)
 {
 }
-void CrateApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void CrateApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems, size_t begin, size_t end)
 {
 
 	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
 	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
 
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-	auto matCB = mCurrFrameResource->MaterialCB->Resource();
+	auto objectCB = mCurrFrameResource->ObjectCB;
+	auto matCB = mCurrFrameResource->MaterialCB;
 	// For each render item...
-	for (size_t i = 0; i < ritems.size(); ++i)
+	for (size_t i = begin; i < end; ++i)
 	{
 		auto ri = ritems[i];
+		Texture* diffuse = ri->Mat->DiffuseMap;
+		if (!ri->Geo->Resident || diffuse == nullptr || diffuse->Resource == nullptr)
+			continue;
 
 		cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
 		cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
 		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
 		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+		tex.Offset(diffuse->SrvHeapIndex, mCbvSrvDescriptorSize);
 
-		D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
-		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex*matCBByteSize;
+		D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB + ri->ObjCBIndex*objCBByteSize;
+		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB + ri->Mat->MatCBIndex*matCBByteSize;
 
 		cmdList->SetGraphicsRootDescriptorTable(0, tex);
 		cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
@@ -992,7 +1203,48 @@ void CrateApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::ve
 		cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
 
 	}
+}
 
+// Console commands of the renderer and the engine tools.
+void CrateApp::RegisterCommands()
+{
+	auto& c = console->Commands;
+	c.add("profile export", "saves the frame profile as a chrome trace", { { "file", trigger::arg_string, true } },
+		[this](const trigger::command_args& a)
+	{
+		std::string file = a.has(0) ? a.get_string(0) : "trigger_trace.json";
+		if (trigger::profiler::export_chrome(file.c_str()))
+			console->AddLog("[log] frame profile saved to %s", file.c_str());
+		else
+			console->AddLog("[error] can't save %s", file.c_str());
+	});
+	c.add("frames", "frame time percentiles and hitches of the render and world loops", {}, [this](const trigger::command_args&)
+	{
+		auto report = [this](const char* loop, const trigger::frame_histogram& h)
+		{
+			auto s = h.get();
+			console->AddLog("[log] %-6s p50 %.2f ms  p95 %.2f ms  p99 %.2f ms  max %.2f ms  hitches %u/%u (%llu in all)",
+				loop, s.p50_ms, s.p95_ms, s.p99_ms, s.max_ms, s.hitches, s.frames, (unsigned long long)s.total_hitches);
+		};
+		report("render", mTimer.Frames());
+		report("world", selected_world->get_frames());
+	});
+	c.add("heap", "live and peak heap bytes per subsystem", {}, [this](const trigger::command_args&)
+	{
+		console->AddLog("[log] %-8s %12s %12s %12s", "tag", "live KB", "peak KB", "allocs");
+		for (int t = 0; t < trigger::tag_count; ++t)
+		{
+			auto s = trigger::alloc_tracker::get((trigger::alloc_tag)t);
+			console->AddLog("[log] %-8s %12.1f %12.1f %12llu", trigger::alloc_tracker::name((trigger::alloc_tag)t),
+				s.live / 1024.0, s.peak / 1024.0, (unsigned long long)s.allocs);
+		}
+	});
+}
+
+void CrateApp::DrawGui(ID3D12GraphicsCommandList* cmdList)
+{
+	TRIGGER_PROFILE_SCOPE("CrateApp::DrawGui");
+	trigger::alloc_scope heap(trigger::tag_ui);
 	static std::string path = "";
 	static std::string name = "";
 	static bool openFileSaveDialog = false;
@@ -1001,6 +1253,11 @@ void CrateApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::ve
 	static bool openLuaSaveDialog = false;
 	static bool openLuaLoadDialog = false;
 	static bool openLuaEditor = false;
+	static bool openScriptStats = false;
+	static bool openFrameProfiler = false;
+	static bool openComponentStats = false;
+	static bool openHeap = false;
+	static bool openFramePacing = false;
 	static string world_name;
 	//Draw Gui
 	ImGui_ImplDX12_NewFrame();
@@ -1020,6 +1277,40 @@ void CrateApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::ve
 		trigger::tlua::open_lua_editor(path + "/" + name, &openLuaEditor);
 	}
 
+	if (openScriptStats)
+	{
+		trigger::tlua::draw_script_stats(&openScriptStats);
+	}
+	trigger::tlua::draw_profiler();
+
+	if (openFrameProfiler)
+	{
+		trigger::profiler::draw(&openFrameProfiler);
+	}
+
+	if (openFramePacing)
+	{
+		ImGui::Begin("Frame Pacing", &openFramePacing);
+		mTimer.Frames().draw("render");
+		ImGui::Separator();
+		selected_world->get_frames().draw("world");
+		ImGui::End();
+	}
+
+	if (openHeap)
+	{
+		trigger::alloc_tracker::draw(&openHeap);
+	}
+
+	if (openComponentStats)
+	{
+		ImGui::Begin("Component Stats", &openComponentStats);
+		if (ImGui::Button("Reset"))
+			selected_world->reset_stats();
+		trigger::component_stats::draw(selected_world->get_stats());
+		ImGui::End();
+	}
+
 	if (openLuaSaveDialog)
 	{
 		if (ImGuiFileDialog::Instance()->FileDialog("Save File", (const char*)".lua", ".", target->name.c_str()))
@@ -1035,6 +1326,7 @@ void CrateApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::ve
 				if (trigger::tlua::save_default_lua_file(path+"/"+name))
 				{
 					console->AddLog("[log] Save Lua File, %s, %s", path.c_str(), name.c_str());
+					trigger::tlua::attach(target, path + "/" + name);
 					openLuaEditor = true;
 				}
 				else
@@ -1144,7 +1436,31 @@ void CrateApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::ve
 		{
 			if (ImGui::MenuItem("Reload Lua"))
 			{
-				trigger::tlua::run("lua/test_actor.lua");
+				trigger::tlua::reload_all();
+			}
+			if (ImGui::MenuItem("Lua Scripts"))
+			{
+				openScriptStats = true;
+			}
+			if (ImGui::MenuItem("Lua Profiler"))
+			{
+				trigger::tlua::show_profiler = true;
+			}
+			if (ImGui::MenuItem("Frame Profiler"))
+			{
+				openFrameProfiler = true;
+			}
+			if (ImGui::MenuItem("Component Stats"))
+			{
+				openComponentStats = true;
+			}
+			if (ImGui::MenuItem("Heap"))
+			{
+				openHeap = true;
+			}
+			if (ImGui::MenuItem("Frame Pacing"))
+			{
+				openFramePacing = true;
 			}
 			if (ImGui::MenuItem("Save"))
 			{
@@ -1206,9 +1522,26 @@ void CrateApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::ve
 			}
 			ImGui::EndMenu();
 		}
+		if (ImGui::BeginMenu("Render"))
+		{
+			bool parallel = gParallelRecord.get_bool();
+			if (ImGui::MenuItem("Parallel Recording", nullptr, &parallel))
+				gParallelRecord.set(parallel);
+
+			int budgetMB = gTextureBudgetMB.get_int();
+			if (ImGui::SliderInt("Texture Budget (MB)", &budgetMB, 1, 512))
+				gTextureBudgetMB.set(budgetMB);
+			ImGui::EndMenu();
+		}
+		ImGui::Text("| cpu record %.3f ms (%s, %u workers)", mRecordCpuMs,
+			gParallelRecord.get_bool() ? "parallel" : "serial", mNumRecordWorkers);
+		if (UINT pending = mUploader->Pending())
+			ImGui::Text("| streaming %u assets (%.1f MB staging)", pending, mUploader->StagingBytes() / (1024.0f * 1024.0f));
+		ImGui::Text("| textures %.1f / %.1f MB", mStreamer->ResidentBytes() / (1024.0f * 1024.0f),
+			mStreamer->Budget() / (1024.0f * 1024.0f));
 		ImGui::EndMainMenuBar();
 	}
-	static int height = 250-18;
+	int height = gConsoleHeight.get_int();
 	ImGui::SetNextWindowSize(ImVec2(this->mClientWidth, height));
 	ImGui::SetNextWindowCollapsed(false);
 	ImGui::SetNextWindowPos(ImVec2(0, this->mClientHeight- height));
@@ -1251,10 +1584,17 @@ void CrateApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::ve
 				}
 				if (ImGui::MenuItem("delete"))
 				{
-					if (selected_world->delete_component(target))
+					// The world frees the actor, so the selection moves off it first.
+					auto actors = selected_world->get_components<trigger::actor>();
+					auto victim = std::find(actors.begin(), actors.end(), target);
+					if (victim != actors.end())
 					{
-						trigger::tlua::_load_destroy_func();
+						trigger::tlua::_load_destroy_func(target);
 						console->AddLog("[log] %s is Deleted in World!", target->name.c_str());
+						actors.erase(victim);
+						auto deleted = target;
+						target = actors.empty() ? mSpareTarget.get() : actors.front();
+						selected_world->delete_component(deleted);
 					}
 					else
 					{
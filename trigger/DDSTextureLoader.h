@@ -25,10 +25,12 @@
 #include <wrl.h>
 #include <d3d11_1.h>
 #include "d3dx12.h"
+#include "DDSLayout.h"
 
 #pragma warning(push)
 #pragma warning(disable : 4005)
 #include <stdint.h>
+#include <vector>
 
 #pragma warning(pop)
 
@@ -75,6 +77,61 @@ namespace DirectX
 		                                 _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
 		                                 );
 
+	// Creates only the texture, in D3D12_RESOURCE_STATE_COMMON, and returns its
+	// subresources pointing into ddsData.  Nothing is recorded, so the caller
+	// can upload them on any queue.  ddsData must outlive the upload.
+	HRESULT CreateDDSTextureResourceFromMemory12(_In_ ID3D12Device* device,
+		                                         _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+		                                         _In_ size_t ddsDataSize,
+		                                         _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
+		                                         _Out_ std::vector<D3D12_SUBRESOURCE_DATA>& subresources,
+		                                         _In_ size_t maxsize = 0
+		                                         );
+
+	// A DDS file mapped read-only into memory, with the header parsed in place.
+	// Texel data is never copied out of the mapping, it goes straight from the
+	// file's pages into an upload heap with WriteDDSSubresources12.
+	class DDSMappedFile
+	{
+	public:
+		DDSMappedFile() = default;
+		DDSMappedFile(const DDSMappedFile& rhs) = delete;
+		DDSMappedFile& operator=(const DDSMappedFile& rhs) = delete;
+		~DDSMappedFile();
+
+		HRESULT Open(_In_z_ const wchar_t* szFileName, _In_ size_t maxsize = 0);
+		void Close();
+
+		const uint8_t* Data() const { return m_view; }
+		size_t Size() const { return m_size; }
+		const DDS::LAYOUT& Layout() const { return m_layout; }
+
+	private:
+		HANDLE m_file = nullptr;
+		HANDLE m_mapping = nullptr;
+		const uint8_t* m_view = nullptr;
+		size_t m_size = 0;
+		DDS::LAYOUT m_layout;
+	};
+
+	// Creates the texture described by file in D3D12_RESOURCE_STATE_COMMON.
+	HRESULT CreateDDSTextureFromMappedFile12(_In_ ID3D12Device* device,
+		                                     _In_ const DDSMappedFile& file,
+		                                     _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture
+		                                     );
+
+	// Writes every subresource of file into uploadHeap at uploadOffset, laid out for
+	// texture, and records the copies on cmdList.  texture must be in COPY_DEST or
+	// promotable to it; cmdList can be a copy list.  uploadHeap needs
+	// GetRequiredIntermediateSize(texture) bytes from uploadOffset.
+	HRESULT WriteDDSSubresources12(_In_ ID3D12Device* device,
+		                           _In_ ID3D12GraphicsCommandList* cmdList,
+		                           _In_ const DDSMappedFile& file,
+		                           _In_ ID3D12Resource* texture,
+		                           _In_ ID3D12Resource* uploadHeap,
+		                           _In_ UINT64 uploadOffset
+		                           );
+
     HRESULT CreateDDSTextureFromFile( _In_ ID3D11Device* d3dDevice,
                                       _In_z_ const wchar_t* szFileName,
                                       _Outptr_opt_ ID3D11Resource** texture,
@@ -2,7 +2,7 @@
 
 #include "d3dUtil.h"
 #include "MathHelper.h"
-#include "UploadBuffer.h"
+#include "UploadRing.h"
 
 struct ObjectConstants
 {
@@ -50,7 +50,7 @@ struct FrameResource
 {
 public:
     
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
+    FrameResource(ID3D12Device* device, UINT workerCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -59,12 +59,17 @@ public:
     // So each frame needs their own allocator.
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 
+    // One allocator per recording worker.  A worker records its slice of the
+    // scene into its own command list, and an allocator can only back one
+    // recording list at a time.
+    std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> WorkerCmdListAllocs;
+
     // We cannot update a cbuffer until the GPU is done processing the commands
-    // that reference it.  So each frame needs their own cbuffers.
-   // std::unique_ptr<UploadBuffer<FrameConstants>> FrameCB = nullptr;
-    std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
-    std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialCB = nullptr;
-    std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
+    // that reference it.  So each frame sub-allocates fresh cbuffers from the
+    // shared UploadRing; these are the GPU addresses of this frame's blocks.
+    D3D12_GPU_VIRTUAL_ADDRESS PassCB = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS MaterialCB = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS ObjectCB = 0;
 
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
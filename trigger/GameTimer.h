@@ -5,6 +5,9 @@
 #ifndef GAMETIMER_H
 #define GAMETIMER_H
 
+#include <cstdint>
+#include "trigger_clock.h"
+
 class GameTimer
 {
 public:
@@ -18,17 +21,22 @@ public:
 	void Stop();  // Call when paused.
 	void Tick();  // Call every frame.
 
+	// Frame times of the ticks while running.
+	const trigger::frame_histogram& Frames()const;
+
 private:
 	double mSecondsPerCount;
 	double mDeltaTime;
 
-	__int64 mBaseTime;
-	__int64 mPausedTime;
-	__int64 mStopTime;
-	__int64 mPrevTime;
-	__int64 mCurrTime;
+	int64_t mBaseTime;
+	int64_t mPausedTime;
+	int64_t mStopTime;
+	int64_t mPrevTime;
+	int64_t mCurrTime;
 
 	bool mStopped;
+
+	trigger::frame_histogram mFrames;
 };
 
 #endif // GAMETIMER_H
\ No newline at end of file
@@ -0,0 +1,239 @@
+#include "TextureStreamer.h"
+
+using Microsoft::WRL::ComPtr;
+
+TextureStreamer::TextureStreamer(ID3D12Device* device, AssetUploader* uploader, ID3D12DescriptorHeap* srvHeap,
+    UINT firstSrvHeapIndex, UINT maxTextures, UINT64 budgetBytes)
+    : mDevice(device), mUploader(uploader), mSrvHeap(srvHeap),
+      mNextSrvHeapIndex(firstSrvHeapIndex), mEndSrvHeapIndex(firstSrvHeapIndex + 2 * maxTextures),
+      mBudget(budgetBytes)
+{
+    mSrvDescriptorSize = mDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+}
+
+void TextureStreamer::Add(Texture* tex)
+{
+    ThrowIfFailed(mNextSrvHeapIndex + 2 <= mEndSrvHeapIndex ? S_OK : E_OUTOFMEMORY);
+
+    // Only the header is looked at here, the texels are read by the uploader.
+    DirectX::DDSMappedFile file;
+    ThrowIfFailed(file.Open(tex->Filename.c_str()));
+
+    const DDS::LAYOUT& layout = file.Layout();
+    tex->Width = layout.width;
+    tex->Height = layout.height;
+    tex->MipCount = layout.mipCount;
+    tex->MipBytes.assign(layout.mipCount, 0);
+    for(size_t i = 0; i < layout.subresources.size(); ++i)
+    {
+        const auto& sub = layout.subresources[i];
+        tex->MipBytes[i % layout.mipCount] += sub.sliceBytes * sub.depth;
+    }
+    tex->ResidentMip = tex->MipCount;
+    tex->Resource = nullptr;
+
+    auto e = std::make_unique<Entry>();
+    e->Tex = tex;
+    e->SrvSlots[0] = mNextSrvHeapIndex++;
+    e->SrvSlots[1] = mNextSrvHeapIndex++;
+
+    // The mip tail: the largest mip that is no bigger than MinResidentSize.
+    e->TailMip = tex->MipCount - 1;
+    while(e->TailMip > 0 &&
+        std::max<UINT>(tex->Width >> (e->TailMip - 1), tex->Height >> (e->TailMip - 1)) <= MinResidentSize)
+    {
+        --e->TailMip;
+    }
+    e->WantedMip = e->TailMip;
+
+    mLookup[tex] = e.get();
+    Load(*e, e->TailMip);
+    mEntries.push_back(std::move(e));
+}
+
+void TextureStreamer::Request(Texture* tex, UINT mip)
+{
+    auto it = mLookup.find(tex);
+    if(it == mLookup.end())
+        return;
+
+    Entry& e = *it->second;
+    if(e.LastUsedFrame != mFrame)
+    {
+        // First request this frame.
+        e.LastUsedFrame = mFrame;
+        e.WantedMip = e.TailMip;
+    }
+    e.WantedMip = std::min<UINT>(e.WantedMip, mip);
+}
+
+UINT TextureStreamer::DemandMip(const Texture& tex, float pixels)
+{
+    if(tex.MipCount == 0)
+        return 0;
+
+    // Every mip halves the texels across, so one mip per halving of the
+    // screen coverage relative to the top mip.
+    float texels = (float)std::max<UINT>(tex.Width, tex.Height);
+    if(pixels >= texels)
+        return 0;
+
+    float mip = std::floor(std::log2(texels / std::max<float>(pixels, 1.0f)));
+    return std::min<UINT>((UINT)mip, tex.MipCount - 1);
+}
+
+void TextureStreamer::Update(UINT64 completedFence, UINT64 submittedFence)
+{
+    mSubmittedFence = submittedFence;
+
+    mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(),
+        [completedFence](const Retired& r) { return r.Fence <= completedFence; }),
+        mRetired.end());
+
+    // Most recently used first, so that the textures in view refine first.
+    std::vector<Entry*> order;
+    order.reserve(mEntries.size());
+    for(auto& e : mEntries)
+        order.push_back(e.get());
+    std::sort(order.begin(), order.end(),
+        [](const Entry* a, const Entry* b) { return a->LastUsedFrame > b->LastUsedFrame; });
+
+    // The budget went down: give mips back until the textures fit again.
+    UINT started = 0;
+    if(mProjectedBytes > mBudget)
+        EvictFor(nullptr, 0, completedFence, started);
+
+    for(Entry* e : order)
+    {
+        if(started >= MaxUploadsPerFrame)
+            break;
+
+        Texture* tex = e->Tex;
+        if(e->Pending || e->Failures >= MaxLoadFailures || e->RetireFence > completedFence)
+            continue;
+
+        // The mip tail did not load.
+        if(tex->Resource == nullptr)
+        {
+            Load(*e, e->TailMip);
+            ++started;
+            continue;
+        }
+
+        // Not seen for a while: fall back to the tail when memory is needed.
+        UINT wanted = (e->LastUsedFrame + 1 >= mFrame) ? e->WantedMip : e->TailMip;
+        if(wanted >= tex->ResidentMip)
+            continue;
+
+        // One mip at a time, so every step is a small upload.
+        UINT target = tex->ResidentMip - 1;
+        UINT64 growth = BytesFrom(*e, target) - BytesFrom(*e, tex->ResidentMip);
+        if(mProjectedBytes + growth > mBudget)
+        {
+            EvictFor(e, growth, completedFence, started);
+            continue;
+        }
+
+        Load(*e, target);
+        ++started;
+    }
+
+    ++mFrame;
+}
+
+UINT64 TextureStreamer::BytesFrom(const Entry& e, UINT mip)const
+{
+    UINT64 bytes = 0;
+    for(UINT i = mip; i < e.Tex->MipCount; ++i)
+        bytes += e.Tex->MipBytes[i];
+    return bytes;
+}
+
+void TextureStreamer::Load(Entry& e, UINT mip)
+{
+    Texture* tex = e.Tex;
+    size_t maxsize = std::max<size_t>(1, std::max<UINT>(tex->Width >> mip, tex->Height >> mip));
+
+    e.Pending = true;
+    ++mPendingUploads;
+    mProjectedBytes += BytesFrom(e, mip) - tex->ResidentBytes();
+
+    Entry* entry = &e;
+    mUploader->QueueTexture(tex->Filename, maxsize, [this, entry, mip](ComPtr<ID3D12Resource> resource)
+    {
+        OnResident(*entry, mip, resource);
+    });
+}
+
+void TextureStreamer::OnResident(Entry& e, UINT mip, ComPtr<ID3D12Resource> resource)
+{
+    Texture* tex = e.Tex;
+    e.Pending = false;
+    --mPendingUploads;
+
+    // The texture keeps its resource, Update tries again.
+    if(resource == nullptr)
+    {
+        mProjectedBytes -= BytesFrom(e, mip) - tex->ResidentBytes();
+        ++e.Failures;
+        return;
+    }
+    e.Failures = 0;
+
+    // The view goes into the slot not in use; frames in flight keep the other.
+    UINT slot = e.ActiveSlot ^ 1;
+    CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvHeap->GetCPUDescriptorHandleForHeapStart());
+    hDescriptor.Offset(e.SrvSlots[slot], mSrvDescriptorSize);
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srvDesc.Format = resource->GetDesc().Format;
+    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Texture2D.MostDetailedMip = 0;
+    srvDesc.Texture2D.MipLevels = resource->GetDesc().MipLevels;
+    srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+    mDevice->CreateShaderResourceView(resource.Get(), &srvDesc, hDescriptor);
+
+    mResidentBytes -= tex->ResidentBytes();
+    if(tex->Resource != nullptr)
+        mRetired.push_back({ tex->Resource, mSubmittedFence });
+
+    tex->Resource = resource;
+    tex->ResidentMip = mip;
+    tex->SrvHeapIndex = e.SrvSlots[slot];
+    mResidentBytes += tex->ResidentBytes();
+
+    e.ActiveSlot = slot;
+    e.RetireFence = mSubmittedFence;
+}
+
+// Drops the top mip of the least recently used textures until bytes more fit
+// in the budget, within the uploads left for this frame.  With e, only the
+// textures used less recently than e give up a mip for it.
+void TextureStreamer::EvictFor(const Entry* e, UINT64 bytes, UINT64 completedFence, UINT& started)
+{
+    std::vector<Entry*> victims;
+    for(auto& v : mEntries)
+    {
+        Texture* tex = v->Tex;
+        if(v.get() == e || v->Pending || v->Failures >= MaxLoadFailures || tex->Resource == nullptr ||
+            v->RetireFence > completedFence)
+            continue;
+        if(tex->ResidentMip >= v->TailMip || (e != nullptr && v->LastUsedFrame >= e->LastUsedFrame))
+            continue;
+        victims.push_back(v.get());
+    }
+    std::sort(victims.begin(), victims.end(),
+        [](const Entry* a, const Entry* b) { return a->LastUsedFrame < b->LastUsedFrame; });
+
+    // The memory comes back when the smaller copies are swapped in, so a
+    // refinement itself waits for a later frame.
+    for(Entry* v : victims)
+    {
+        if(started >= MaxUploadsPerFrame || mProjectedBytes + bytes <= mBudget)
+            break;
+
+        Load(*v, v->Tex->ResidentMip + 1);
+        ++started;
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "d3dUtil.h"
+#include "AssetUploader.h"
+
+// Keeps the mips of DDS textures resident on demand, within a memory budget.
+//
+// A texture starts with its mip tail only, the mips no larger than
+// MinResidentSize, and is refined one mip at a time towards the most detailed
+// mip requested for it.  Going from one residency to another uploads a new
+// resource with the new mip range through the AssetUploader and swaps it in
+// once the copy is done.  When a refinement would not fit in the budget, the
+// least recently used textures give up their top mip first.
+//
+// An upload that fails is tried again in a later Update, and after
+// MaxLoadFailures failures in a row the texture keeps what it has.
+//
+// Each texture owns two SRV heap slots.  A swap writes the view into the slot
+// not in use, and the replaced resource is released once the graphics fence
+// has passed every frame that could have used it.
+//
+// Everything runs on the main thread; the recording threads only read
+// Texture::Resource and Texture::SrvHeapIndex.
+class TextureStreamer
+{
+public:
+    // srvHeap slots [firstSrvHeapIndex, firstSrvHeapIndex + 2 * maxTextures) belong to the streamer.
+    TextureStreamer(ID3D12Device* device, AssetUploader* uploader, ID3D12DescriptorHeap* srvHeap,
+        UINT firstSrvHeapIndex, UINT maxTextures, UINT64 budgetBytes);
+    TextureStreamer(const TextureStreamer& rhs) = delete;
+    TextureStreamer& operator=(const TextureStreamer& rhs) = delete;
+
+    // Reads the header of tex->Filename and queues its mip tail.  tex must
+    // outlive the streamer.
+    void Add(Texture* tex);
+
+    // tex is needed at mip this frame.  The most detailed request wins.
+    void Request(Texture* tex, UINT mip);
+
+    // Mip to sample tex at when it covers pixels texels on screen.
+    static UINT DemandMip(const Texture& tex, float pixels);
+
+    // Once per frame on the main thread, after the frame fence wait and before
+    // AssetUploader::Pump().  submittedFence is the last fence value signaled
+    // on the graphics queue.
+    void Update(UINT64 completedFence, UINT64 submittedFence);
+
+    // Lowering the budget gives mips back, least recently used first, over
+    // the next Updates.
+    UINT64 Budget()const { return mBudget; }
+    void SetBudget(UINT64 bytes) { mBudget = bytes; }
+    UINT64 ResidentBytes()const { return mResidentBytes; }
+    UINT PendingUploads()const { return mPendingUploads; }
+
+    // Mips no larger than this are loaded up front and never evicted.
+    static const UINT MinResidentSize = 64;
+
+    // Uploads started per Update, refinements and evictions alike, to bound
+    // the work per frame.
+    static const UINT MaxUploadsPerFrame = 4;
+
+    static const UINT MaxLoadFailures = 3;
+
+private:
+    struct Entry
+    {
+        Texture* Tex = nullptr;
+        UINT TailMip = 0;
+        UINT WantedMip = 0;
+        UINT64 LastUsedFrame = 0;
+        bool Pending = false;
+        UINT Failures = 0;      // uploads failed in a row
+        UINT SrvSlots[2] = { 0, 0 };
+        UINT ActiveSlot = 0;
+
+        // Graphics fence after which the slot not in use and the previous
+        // resource are free again.
+        UINT64 RetireFence = 0;
+    };
+
+    struct Retired
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+        UINT64 Fence;
+    };
+
+    UINT64 BytesFrom(const Entry& e, UINT mip)const;
+    void Load(Entry& e, UINT mip);
+    void OnResident(Entry& e, UINT mip, Microsoft::WRL::ComPtr<ID3D12Resource> resource);
+    void EvictFor(const Entry* e, UINT64 bytes, UINT64 completedFence, UINT& started);
+
+    ID3D12Device* mDevice = nullptr;
+    AssetUploader* mUploader = nullptr;
+    ID3D12DescriptorHeap* mSrvHeap = nullptr;
+    UINT mSrvDescriptorSize = 0;
+    UINT mNextSrvHeapIndex = 0;
+    UINT mEndSrvHeapIndex = 0;
+
+    std::vector<std::unique_ptr<Entry>> mEntries;
+    std::unordered_map<Texture*, Entry*> mLookup;
+    std::vector<Retired> mRetired;
+
+    UINT64 mBudget = 0;
+    UINT64 mResidentBytes = 0;
+    UINT64 mProjectedBytes = 0;     // resident once the pending uploads are in
+    UINT64 mFrame = 0;
+    UINT64 mSubmittedFence = 0;
+    UINT mPendingUploads = 0;
+};
@@ -0,0 +1,131 @@
+#include "UploadRing.h"
+
+UploadRing::UploadRing(ID3D12Device* device, UINT64 byteSize) : mDevice(device)
+{
+    CreateHeap(byteSize);
+}
+
+UploadRing::~UploadRing()
+{
+    if(mUploadHeap != nullptr)
+        mUploadHeap->Unmap(0, nullptr);
+
+    mMappedData = nullptr;
+}
+
+void UploadRing::CreateHeap(UINT64 byteSize)
+{
+    ThrowIfFailed(mDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&mUploadHeap)));
+
+    // Mapped once for the lifetime of the heap.  We never read through this
+    // pointer, the memory is write-combined.
+    ThrowIfFailed(mUploadHeap->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+
+    mBaseAddress = mUploadHeap->GetGPUVirtualAddress();
+    mCapacity = byteSize;
+    mHead = 0;
+    mTail = 0;
+    mUsed = 0;
+    mFrameUsed = 0;
+}
+
+bool UploadRing::TryAllocate(UINT64 byteSize, UINT64 alignment, UINT64& offset)
+{
+    if(mUsed >= mCapacity)
+        return false;
+
+    UINT64 aligned = (mHead + alignment - 1) & ~(alignment - 1);
+    if(mHead >= mTail)
+    {
+        // Free space is [head, capacity) followed by [0, tail).
+        if(aligned + byteSize <= mCapacity)
+        {
+            offset = aligned;
+        }
+        else if(byteSize <= mTail)
+        {
+            // Skip the end of the heap; the gap is handed back with this frame.
+            aligned = 0;
+            offset = 0;
+            mUsed += mCapacity - mHead;
+            mFrameUsed += mCapacity - mHead;
+            mHead = 0;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    else if(aligned + byteSize <= mTail)
+    {
+        offset = aligned;
+    }
+    else
+    {
+        return false;
+    }
+
+    UINT64 size = offset + byteSize - mHead;
+    mUsed += size;
+    mFrameUsed += size;
+    mHead = offset + byteSize;
+    return true;
+}
+
+UploadRing::Allocation UploadRing::Allocate(UINT64 byteSize, UINT64 alignment)
+{
+    UINT64 offset = 0;
+    if(!TryAllocate(byteSize, alignment, offset))
+    {
+        // Out of space: move to a bigger heap.  Allocations already handed out
+        // this frame still point into the old one, so keep it alive until the
+        // frame that is being recorded has retired.
+        UINT64 size = mCapacity * 2;
+        while(size < byteSize + alignment)
+            size *= 2;
+
+        mRetired.push_back({ mUploadHeap, 0 });
+        mUploadHeap->Unmap(0, nullptr);
+        mFrames.clear();
+        CreateHeap(size);
+
+        ThrowIfFailed(TryAllocate(byteSize, alignment, offset) ? S_OK : E_OUTOFMEMORY);
+    }
+
+    Allocation a;
+    a.CPU = mMappedData + offset;
+    a.GPU = mBaseAddress + offset;
+    return a;
+}
+
+void UploadRing::FinishFrame(UINT64 fence)
+{
+    mFrames.push_back({ fence, mHead, mFrameUsed });
+    mFrameUsed = 0;
+
+    for(auto& r : mRetired)
+    {
+        if(r.Fence == 0)
+            r.Fence = fence;
+    }
+}
+
+void UploadRing::Reclaim(UINT64 completedFence)
+{
+    while(!mFrames.empty() && mFrames.front().Fence <= completedFence)
+    {
+        mTail = mFrames.front().End;
+        mUsed -= mFrames.front().Size;
+        mFrames.pop_front();
+    }
+
+    mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(),
+        [completedFence](const RetiredHeap& r) { return r.Fence != 0 && r.Fence <= completedFence; }),
+        mRetired.end());
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "d3dUtil.h"
+#include <deque>
+
+// A linear ring allocator over one large, persistently mapped upload heap.
+// Per-frame transient data (pass, object and material constants) is bulk
+// sub-allocated from it every frame, and the space is handed back once the
+// GPU fence passes the frame that used it.  When a frame does not fit, the
+// ring grows into a bigger heap and the old one is released after its last
+// frame retires, so the number of objects is not fixed at startup.
+class UploadRing
+{
+public:
+    struct Allocation
+    {
+        BYTE* CPU = nullptr;
+        D3D12_GPU_VIRTUAL_ADDRESS GPU = 0;
+    };
+
+    UploadRing(ID3D12Device* device, UINT64 byteSize);
+    UploadRing(const UploadRing& rhs) = delete;
+    UploadRing& operator=(const UploadRing& rhs) = delete;
+    ~UploadRing();
+
+    Allocation Allocate(UINT64 byteSize, UINT64 alignment);
+
+    // Allocates count constant buffer elements of type T in one block.
+    // Elements are laid out CalcConstantBufferByteSize(sizeof(T)) apart.
+    template<typename T>
+    Allocation AllocateConstants(UINT count)
+    {
+        UINT64 stride = d3dUtil::CalcConstantBufferByteSize(sizeof(T));
+        return Allocate(stride * (count > 0 ? count : 1), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+    }
+
+    // Everything allocated since the last call is used by the frame that
+    // signals this fence value.
+    void FinishFrame(UINT64 fence);
+
+    // Hands back the space of every frame whose fence has completed.
+    void Reclaim(UINT64 completedFence);
+
+    UINT64 Capacity()const { return mCapacity; }
+    UINT64 Used()const { return mUsed; }
+
+private:
+    struct FrameMark
+    {
+        UINT64 Fence;
+        UINT64 End;
+        UINT64 Size;
+    };
+
+    struct RetiredHeap
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+        UINT64 Fence;
+    };
+
+    void CreateHeap(UINT64 byteSize);
+    bool TryAllocate(UINT64 byteSize, UINT64 alignment, UINT64& offset);
+
+    ID3D12Device* mDevice = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> mUploadHeap;
+    BYTE* mMappedData = nullptr;
+    D3D12_GPU_VIRTUAL_ADDRESS mBaseAddress = 0;
+
+    UINT64 mCapacity = 0;
+    UINT64 mHead = 0;
+    UINT64 mTail = 0;
+    UINT64 mUsed = 0;
+    UINT64 mFrameUsed = 0;
+
+    std::deque<FrameMark> mFrames;
+    std::vector<RetiredHeap> mRetired;
+};
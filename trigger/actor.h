@@ -1,13 +1,9 @@
 #pragma once
 #include <string>
-#include <DirectXMath.h>
 #include "component.h"
 #include "fsm.h"
 #include "vec.h"
 
-
-using namespace DirectX;
-
 namespace trigger
 {
 	struct transform
@@ -0,0 +1,164 @@
+#include "alloc_tracker.h"
+#include <cstdlib>
+#include <cassert>
+#include "imgui.h"
+
+// Zero before any constructor runs, so allocations of static initializers are counted too.
+trigger::alloc_tracker::counters trigger::alloc_tracker::table[tag_count];
+uint64_t trigger::alloc_tracker::frame_start[tag_count];
+uint64_t trigger::alloc_tracker::last_frame[tag_count];
+thread_local trigger::alloc_tag trigger::alloc_tracker::current_tag = trigger::tag_other;
+
+namespace
+{
+	// 16 bytes, so blocks keep the alignment of malloc.
+	struct header
+	{
+		uint64_t size;
+		uint32_t tag;
+		uint32_t magic;
+	};
+
+	const uint32_t live_magic = 0x54524947;	// "TRIG"
+}
+
+void *trigger::alloc_tracker::allocate(size_t size, alloc_tag tag) noexcept
+{
+	auto h = (header*)malloc(sizeof(header) + size);
+	if (h == nullptr)
+		return nullptr;
+	h->size = size;
+	h->tag = tag;
+	h->magic = live_magic;
+	add(tag, size);
+	return h + 1;
+}
+
+void trigger::alloc_tracker::release(void *p) noexcept
+{
+	if (p == nullptr)
+		return;
+	// Every block deleted here came from the operator new below.
+	auto h = (header*)p - 1;
+	assert(h->magic == live_magic && "delete of a block not from operator new, or deleted twice");
+	remove((alloc_tag)h->tag, (size_t)h->size);
+	h->magic = 0;
+	free(h);
+}
+
+trigger::alloc_tracker::stats trigger::alloc_tracker::get(alloc_tag tag)
+{
+	auto &c = table[tag];
+	stats s;
+	s.live = c.live.load(std::memory_order_relaxed);
+	s.peak = c.peak.load(std::memory_order_relaxed);
+	s.allocs = c.allocs.load(std::memory_order_relaxed);
+	s.frees = c.frees.load(std::memory_order_relaxed);
+	s.frame_allocs = last_frame[tag];
+	return s;
+}
+
+const char *trigger::alloc_tracker::name(alloc_tag tag)
+{
+	static const char *names[tag_count] = { "other", "world", "fsm", "lua", "ui", "toml", "render" };
+	return tag < tag_count ? names[tag] : "?";
+}
+
+void trigger::alloc_tracker::frame()
+{
+	for (uint32_t i = 0; i < tag_count; ++i)
+	{
+		uint64_t allocs = table[i].allocs.load(std::memory_order_relaxed);
+		last_frame[i] = allocs - frame_start[i];
+		frame_start[i] = allocs;
+	}
+}
+
+void trigger::alloc_tracker::draw(bool *window)
+{
+	if (!ImGui::Begin("Heap", window))
+	{
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Columns(6, "heap");
+	ImGui::Text("tag"); ImGui::NextColumn();
+	ImGui::Text("live KB"); ImGui::NextColumn();
+	ImGui::Text("peak KB"); ImGui::NextColumn();
+	ImGui::Text("blocks"); ImGui::NextColumn();
+	ImGui::Text("allocs/frame"); ImGui::NextColumn();
+	ImGui::Text("allocs"); ImGui::NextColumn();
+	ImGui::Separator();
+	int64_t total = 0;
+	for (uint32_t i = 0; i < tag_count; ++i)
+	{
+		auto s = get((alloc_tag)i);
+		total += s.live;
+		ImGui::Text("%s", name((alloc_tag)i)); ImGui::NextColumn();
+		ImGui::Text("%.1f", s.live / 1024.0); ImGui::NextColumn();
+		ImGui::Text("%.1f", s.peak / 1024.0); ImGui::NextColumn();
+		ImGui::Text("%lld", (long long)(s.allocs - s.frees)); ImGui::NextColumn();
+		ImGui::Text("%llu", (unsigned long long)s.frame_allocs); ImGui::NextColumn();
+		ImGui::Text("%llu", (unsigned long long)s.allocs); ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+	ImGui::Separator();
+	ImGui::Text("%.1f KB live", total / 1024.0);
+	ImGui::End();
+}
+
+// Every new and delete of the program goes through the tracker.
+
+void *operator new(size_t size)
+{
+	void *p = trigger::alloc_tracker::allocate(size, trigger::alloc_tracker::current());
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return trigger::alloc_tracker::allocate(size, trigger::alloc_tracker::current());
+}
+
+void *operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return trigger::alloc_tracker::allocate(size, trigger::alloc_tracker::current());
+}
+
+void operator delete(void *p) noexcept
+{
+	trigger::alloc_tracker::release(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	trigger::alloc_tracker::release(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	trigger::alloc_tracker::release(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	trigger::alloc_tracker::release(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) noexcept
+{
+	trigger::alloc_tracker::release(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept
+{
+	trigger::alloc_tracker::release(p);
+}
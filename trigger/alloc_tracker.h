@@ -0,0 +1,138 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+
+namespace trigger
+{
+	// Subsystems the heap is accounted to.
+	enum alloc_tag : uint32_t
+	{
+		tag_other,
+		tag_world,
+		tag_fsm,
+		tag_lua,
+		tag_ui,
+		tag_toml,
+		tag_render,
+		tag_count,
+	};
+
+	// Engine-wide heap accounting.
+	//
+	// The global operator new and delete (alloc_tracker.cpp) put a small
+	// header in front of every block, with its size and the tag it was
+	// allocated under, and keep live bytes, peak and allocation counts per
+	// tag.  The tag is the one of the innermost alloc_scope on the thread,
+	// tag_other outside of any; classes deriving from tracked<tag> always
+	// allocate under their own.  Allocators of their own, like the lua one,
+	// report through add() and remove().
+	class alloc_tracker
+	{
+	public:
+		struct counters
+		{
+			std::atomic<int64_t> live;
+			std::atomic<int64_t> peak;
+			std::atomic<uint64_t> allocs;
+			std::atomic<uint64_t> frees;
+		};
+
+		// As shown, with the allocations of the last frame.
+		struct stats
+		{
+			int64_t live;
+			int64_t peak;
+			uint64_t allocs;
+			uint64_t frees;
+			uint64_t frame_allocs;
+		};
+
+		static void *allocate(size_t size, alloc_tag tag) noexcept;
+		static void release(void *p) noexcept;
+
+		static inline void add(alloc_tag tag, size_t size) noexcept
+		{
+			auto &c = table[tag];
+			int64_t live = c.live.fetch_add((int64_t)size, std::memory_order_relaxed) + (int64_t)size;
+			c.allocs.fetch_add(1, std::memory_order_relaxed);
+			int64_t peak = c.peak.load(std::memory_order_relaxed);
+			while (live > peak && !c.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		static inline void remove(alloc_tag tag, size_t size) noexcept
+		{
+			auto &c = table[tag];
+			c.live.fetch_sub((int64_t)size, std::memory_order_relaxed);
+			c.frees.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// A block of tag changed size in place, without a new allocation.
+		static inline void resize(alloc_tag tag, int64_t delta) noexcept
+		{
+			table[tag].live.fetch_add(delta, std::memory_order_relaxed);
+		}
+
+		static inline alloc_tag &current() noexcept
+		{
+			return current_tag;
+		}
+
+		static stats get(alloc_tag tag);
+		static const char *name(alloc_tag tag);
+
+		// Once a frame, on the main thread: closes the per frame counts.
+		static void frame();
+
+		static void draw(bool *window);
+
+	private:
+		static counters table[tag_count];
+		static uint64_t frame_start[tag_count];
+		static uint64_t last_frame[tag_count];
+		static thread_local alloc_tag current_tag;
+	};
+
+	// Allocations of this thread go to tag until the end of the block.
+	class alloc_scope
+	{
+	public:
+		explicit alloc_scope(alloc_tag tag) : previous(alloc_tracker::current())
+		{
+			alloc_tracker::current() = tag;
+		}
+
+		~alloc_scope()
+		{
+			alloc_tracker::current() = previous;
+		}
+
+		alloc_scope(const alloc_scope&) = delete;
+		alloc_scope& operator=(const alloc_scope&) = delete;
+
+	private:
+		alloc_tag previous;
+	};
+
+	// Base of the classes always accounted to Tag, whoever news them.
+	template<alloc_tag Tag>
+	class tracked
+	{
+	public:
+		static void *operator new(size_t size)
+		{
+			void *p = alloc_tracker::allocate(size, Tag);
+			if (p == nullptr)
+				throw std::bad_alloc();
+			return p;
+		}
+
+		static void operator delete(void *p) noexcept
+		{
+			alloc_tracker::release(p);
+		}
+	};
+}
@@ -0,0 +1,355 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <initializer_list>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+namespace trigger
+{
+	// Type of a command argument, checked before the handler runs.
+	enum command_arg_type
+	{
+		arg_int,
+		arg_float,
+		arg_bool,		// 1/0, on/off, true/false
+		arg_string,		// one word, or "quoted words"
+		arg_text,		// the rest of the line, last argument only
+	};
+
+	struct command_arg
+	{
+		const char *name;
+		command_arg_type type;
+		bool optional;
+	};
+
+	// The arguments of one call, parsed as declared.  Missing optional ones
+	// are not there: size() says how many were given.
+	class command_args
+	{
+	public:
+		struct value
+		{
+			std::string text;
+			int64_t i = 0;
+			double f = 0.0;
+			bool b = false;
+		};
+
+		size_t size() const { return values.size(); }
+		bool has(size_t n) const { return n < values.size(); }
+
+		int get_int(size_t n, int def = 0) const { return has(n) ? (int)values[n].i : def; }
+		float get_float(size_t n, float def = 0.0f) const { return has(n) ? (float)values[n].f : def; }
+		bool get_bool(size_t n, bool def = false) const { return has(n) ? values[n].b : def; }
+		const std::string &get_string(size_t n) const { static const std::string none; return has(n) ? values[n].text : none; }
+
+	private:
+		friend class command_registry;
+		std::vector<value> values;
+	};
+
+	// Console commands, registered by the subsystems they belong to.
+	//
+	// Names are case-insensitive and may hold spaces ("show world"): the
+	// longest registered name at the start of a line is the command, the rest
+	// are its arguments.  Names are kept in a trie over their lowercase
+	// characters, so lookup and completion cost the length of the name, not
+	// the number of commands.  Main thread only.
+	class command_registry
+	{
+	public:
+		typedef std::function<void(const command_args&)> handler;
+
+		struct command
+		{
+			std::string name;
+			std::string help;
+			std::vector<command_arg> args;
+			handler run;
+		};
+
+		enum result
+		{
+			exec_ok,
+			exec_unknown,
+			exec_bad_args,
+		};
+
+		command_registry()
+		{
+			nodes.resize(1);
+		}
+
+		// False when name is taken.
+		bool add(const std::string &name, const std::string &help, std::initializer_list<command_arg> args, handler run)
+		{
+			uint32_t n = 0;
+			for (char c : name)
+				n = child(n, c, true);
+			if (nodes[n].command >= 0)
+				return false;
+
+			command cmd;
+			cmd.name = name;
+			cmd.help = help;
+			cmd.args = args;
+			cmd.run = run;
+			if (!free_slots.empty())
+			{
+				nodes[n].command = free_slots.back();
+				free_slots.pop_back();
+				commands[nodes[n].command] = std::move(cmd);
+			}
+			else
+			{
+				nodes[n].command = (int32_t)commands.size();
+				commands.push_back(std::move(cmd));
+			}
+			return true;
+		}
+
+		bool remove(const std::string &name)
+		{
+			uint32_t n = walk(name.c_str(), name.size());
+			if (n == none || nodes[n].command < 0)
+				return false;
+			commands[nodes[n].command] = command();
+			free_slots.push_back(nodes[n].command);
+			nodes[n].command = -1;
+			return true;
+		}
+
+		const command *find(const std::string &name) const
+		{
+			uint32_t n = walk(name.c_str(), name.size());
+			return n != none && nodes[n].command >= 0 ? &commands[nodes[n].command] : nullptr;
+		}
+
+		// Commands starting with prefix, in alphabetical order, at most limit.
+		// Returns how many characters all of them share, prefix included.
+		size_t complete(const char *prefix, size_t length, std::vector<const command*> &out, size_t limit = 64) const
+		{
+			out.clear();
+			uint32_t n = walk(prefix, length);
+			if (n == none)
+				return 0;
+
+			size_t common = length;
+			uint32_t c = n;
+			while (nodes[c].command < 0 && nodes[c].next.size() == 1)
+			{
+				c = nodes[c].next[0].second;
+				common++;
+			}
+			collect(n, out, limit);
+			return common;
+		}
+
+		// All of them, in alphabetical order.
+		std::vector<const command*> list() const
+		{
+			std::vector<const command*> out;
+			collect(0, out, (size_t)-1);
+			return out;
+		}
+
+		// Runs line.  On failure error says why, with the usage for bad arguments.
+		result exec(const char *line, std::string &error) const
+		{
+			while (*line == ' ')
+				line++;
+
+			// Longest name that ends on a word boundary of the line.
+			uint32_t n = 0;
+			int32_t found = -1;
+			const char *rest = line;
+			for (const char *p = line; n != none; ++p)
+			{
+				if ((*p == ' ' || *p == 0) && nodes[n].command >= 0)
+				{
+					found = nodes[n].command;
+					rest = p;
+				}
+				if (*p == 0)
+					break;
+				n = child(n, *p);
+			}
+
+			if (found < 0)
+			{
+				error = "Unknown command: '" + std::string(line) + "'";
+				return exec_unknown;
+			}
+
+			const command &cmd = commands[found];
+			command_args args;
+			if (!parse(cmd, rest, args))
+			{
+				error = "usage: " + usage(cmd);
+				return exec_bad_args;
+			}
+			cmd.run(args);
+			return exec_ok;
+		}
+
+		// "name <int> [float]"
+		static std::string usage(const command &cmd)
+		{
+			static const char *types[] = { "int", "float", "bool", "string", "text" };
+			std::string u = cmd.name;
+			for (auto &a : cmd.args)
+			{
+				u += a.optional ? " [" : " <";
+				u += a.name;
+				u += ':';
+				u += types[a.type];
+				u += a.optional ? "]" : ">";
+			}
+			return u;
+		}
+
+	private:
+		static const uint32_t none = 0xffffffff;
+
+		// Children sorted by character, so walking them in order is alphabetical.
+		struct node
+		{
+			std::vector<std::pair<char, uint32_t>> next;
+			int32_t command = -1;
+		};
+
+		std::vector<node> nodes;
+		std::vector<command> commands;
+		std::vector<int32_t> free_slots;
+
+		uint32_t child(uint32_t n, char c) const
+		{
+			c = (char)tolower((unsigned char)c);
+			for (auto &e : nodes[n].next)
+			{
+				if (e.first == c)
+					return e.second;
+				if (e.first > c)
+					break;
+			}
+			return none;
+		}
+
+		uint32_t child(uint32_t n, char c, bool create)
+		{
+			uint32_t found = ((const command_registry*)this)->child(n, c);
+			if (found != none || !create)
+				return found;
+
+			c = (char)tolower((unsigned char)c);
+			uint32_t added = (uint32_t)nodes.size();
+			nodes.emplace_back();
+			auto &next = nodes[n].next;
+			auto at = next.begin();
+			while (at != next.end() && at->first < c)
+				++at;
+			next.insert(at, std::make_pair(c, added));
+			return added;
+		}
+
+		uint32_t walk(const char *s, size_t length) const
+		{
+			uint32_t n = 0;
+			for (size_t i = 0; i < length && n != none; ++i)
+				n = child(n, s[i]);
+			return n;
+		}
+
+		void collect(uint32_t n, std::vector<const command*> &out, size_t limit) const
+		{
+			if (out.size() >= limit)
+				return;
+			if (nodes[n].command >= 0)
+				out.push_back(&commands[nodes[n].command]);
+			for (auto &e : nodes[n].next)
+				collect(e.second, out, limit);
+		}
+
+		static bool parse(const command &cmd, const char *p, command_args &args)
+		{
+			for (auto &a : cmd.args)
+			{
+				while (*p == ' ')
+					p++;
+				if (*p == 0)
+					return a.optional;
+
+				command_args::value v;
+				if (a.type == arg_text)
+				{
+					v.text = p;
+					while (!v.text.empty() && v.text.back() == ' ')
+						v.text.pop_back();
+					args.values.push_back(v);
+					return true;
+				}
+
+				if (*p == '"')
+				{
+					const char *end = strchr(p + 1, '"');
+					if (end == nullptr)
+						return false;
+					v.text.assign(p + 1, end);
+					p = end + 1;
+				}
+				else
+				{
+					const char *end = p;
+					while (*end != 0 && *end != ' ')
+						end++;
+					v.text.assign(p, end);
+					p = end;
+				}
+
+				if (!convert(a.type, v))
+					return false;
+				args.values.push_back(v);
+			}
+
+			while (*p == ' ')
+				p++;
+			return *p == 0;
+		}
+
+		static bool convert(command_arg_type type, command_args::value &v)
+		{
+			const char *s = v.text.c_str();
+			char *end = nullptr;
+			switch (type)
+			{
+			case arg_int:
+				v.i = strtoll(s, &end, 0);
+				v.f = (double)v.i;
+				return !v.text.empty() && *end == 0;
+			case arg_float:
+				v.f = strtod(s, &end);
+				return !v.text.empty() && *end == 0;
+			case arg_bool:
+			{
+				std::string t;
+				for (char c : v.text)
+					t += (char)tolower((unsigned char)c);
+				if (t == "1" || t == "on" || t == "true")
+					v.b = true;
+				else if (t == "0" || t == "off" || t == "false")
+					v.b = false;
+				else
+					return false;
+				return true;
+			}
+			default:
+				return true;
+			}
+		}
+	};
+}
@@ -2,6 +2,7 @@
 #include <string>
 #include "trigger_tools.h"
 #include "cpptoml.h"
+#include "alloc_tracker.h"
 
 //TODO:: Add using macro in import * export component_world's code. 
 
@@ -31,7 +32,7 @@ _tmp->insert(#var_name, var);\
 
 namespace trigger
 {
-	class component
+	class component : public trigger::tracked<tag_world>
 	{
 	protected:
 		std::shared_ptr<cpptoml::table> _params;
@@ -42,6 +43,7 @@ namespace trigger
 
 		component()
 		{
+			alloc_scope toml(tag_toml);
 			_tmp = cpptoml::make_table();
 			_params = cpptoml::make_table();
 			
@@ -59,5 +61,9 @@ namespace trigger
 
 		virtual void update(float delta) noexcept
 		{};
+
+		// Components are deleted through component*, by the world that owns them.
+		virtual ~component()
+		{}
 	};
 }
@@ -0,0 +1,169 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <typeinfo>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include "imgui.h"
+#include "trigger_clock.h"
+
+namespace trigger
+{
+	// Update cost of the components of a world, per component type.
+	//
+	// Times are hires_clock ticks around every update(), converted to ms
+	// only when reported.  Every type keeps a histogram of its update times, 8 buckets
+	// per power of two, which bounds the p99 within 1/8 of its value.
+	class component_stats
+	{
+	public:
+		// One component type, as reported.
+		struct row
+		{
+			std::string name;
+			unsigned int instances;
+			uint64_t calls;
+			double total_ms;
+			double min_ms;
+			double max_ms;
+			double p99_ms;
+		};
+
+		component_stats()
+		{
+			// Starts the calibration of the ticks.
+			hires_clock::seconds_per_tick();
+		}
+
+		static inline uint64_t ticks()
+		{
+			return hires_clock::ticks();
+		}
+
+		// Counts the components of every type from scratch, at the start of a pass.
+		void begin_pass()
+		{
+			for (auto &t : types)
+				t.second.instances = 0;
+		}
+
+		template<typename T>
+		inline void count(const T &c)
+		{
+			of(typeid(c)).instances++;
+		}
+
+		template<typename T>
+		inline void add(const T &c, uint64_t elapsed)
+		{
+			auto &t = of(typeid(c));
+			t.calls++;
+			t.total += elapsed;
+			t.min = std::min<uint64_t>(t.min, elapsed);
+			t.max = std::max<uint64_t>(t.max, elapsed);
+			t.buckets[log_bucket::of(elapsed)]++;
+		}
+
+		void reset()
+		{
+			types.clear();
+			last_type = nullptr;
+			last = nullptr;
+		}
+
+		// Most expensive first.
+		std::vector<row> report() const
+		{
+			double ms = hires_clock::ms_per_tick();
+			std::vector<row> rows;
+			for (auto &t : types)
+			{
+				const type &s = t.second;
+				row r;
+				r.name = s.name;
+				r.instances = s.instances;
+				r.calls = s.calls;
+				r.total_ms = s.total * ms;
+				r.min_ms = s.calls != 0 ? s.min * ms : 0.0;
+				r.max_ms = s.max * ms;
+				r.p99_ms = percentile(s, 0.99) * ms;
+				rows.push_back(r);
+			}
+			std::sort(rows.begin(), rows.end(), [](const row &a, const row &b) { return a.total_ms > b.total_ms; });
+			return rows;
+		}
+
+		static void draw(const std::vector<row> &rows)
+		{
+			ImGui::Columns(7, "component stats");
+			ImGui::Text("type"); ImGui::NextColumn();
+			ImGui::Text("count"); ImGui::NextColumn();
+			ImGui::Text("calls"); ImGui::NextColumn();
+			ImGui::Text("total ms"); ImGui::NextColumn();
+			ImGui::Text("min ms"); ImGui::NextColumn();
+			ImGui::Text("max ms"); ImGui::NextColumn();
+			ImGui::Text("p99 ms"); ImGui::NextColumn();
+			ImGui::Separator();
+			for (auto &r : rows)
+			{
+				ImGui::Text("%s", r.name.c_str()); ImGui::NextColumn();
+				ImGui::Text("%u", r.instances); ImGui::NextColumn();
+				ImGui::Text("%llu", (unsigned long long)r.calls); ImGui::NextColumn();
+				ImGui::Text("%.3f", r.total_ms); ImGui::NextColumn();
+				ImGui::Text("%.4f", r.min_ms); ImGui::NextColumn();
+				ImGui::Text("%.4f", r.max_ms); ImGui::NextColumn();
+				ImGui::Text("%.4f", r.p99_ms); ImGui::NextColumn();
+			}
+			ImGui::Columns(1);
+		}
+
+	private:
+		static const int bucket_count = 64 * 8;
+
+		struct type
+		{
+			std::string name;
+			unsigned int instances = 0;
+			uint64_t calls = 0;
+			uint64_t total = 0;
+			uint64_t min = UINT64_MAX;
+			uint64_t max = 0;
+			uint32_t buckets[bucket_count] = {};
+		};
+
+		// typeid gives one type_info per type, so its address is the key.
+		std::unordered_map<const std::type_info*, type> types;
+		const std::type_info *last_type = nullptr;
+		type *last = nullptr;
+
+		// Components of a type mostly come in runs, hence the last one is kept.
+		inline type &of(const std::type_info &info)
+		{
+			if (&info != last_type)
+			{
+				auto &t = types[&info];
+				if (t.name.empty())
+					t.name = info.name();
+				last_type = &info;
+				last = &t;
+			}
+			return *last;
+		}
+
+		static double percentile(const type &t, double p)
+		{
+			if (t.calls == 0)
+				return 0.0;
+			uint64_t wanted = (uint64_t)(t.calls * p);
+			uint64_t seen = 0;
+			for (int b = 0; b < bucket_count; ++b)
+			{
+				seen += t.buckets[b];
+				if (seen > wanted)
+					return std::min<double>(log_bucket::limit(b), (double)t.max);
+			}
+			return (double)t.max;
+		}
+	};
+}
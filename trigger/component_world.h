@@ -4,29 +4,52 @@
 #include <chrono>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <fstream>
+#include <algorithm>
 
 #include "actor.h"
+#include "profiler.h"
+#include "component_stats.h"
+#include "cvar.h"
 
 using namespace std;
 
 namespace trigger
 {
+	// Engine-wide, on top of the time_scale of each world.  Function statics,
+	// so that every translation unit including this shares one cvar.
+	inline cvar &world_time_scale()
+	{
+		static cvar v("world_time_scale", 1.0f, 0.0f, 16.0f, "scales the time of every world");
+		return v;
+	}
+
+	inline cvar &world_gravity()
+	{
+		static cvar v("world_gravity", -9.8f, -100.0f, 100.0f, "gravity of new worlds");
+		return v;
+	}
+
 	class component_world : public trigger::component
 	{
-		typedef chrono::high_resolution_clock time;
-		typedef chrono::time_point<chrono::steady_clock> Time;
+		typedef hires_clock::steady time;
+		typedef time::time_point Time;
 
 	private:
 		list<component*> components;
 		Time start_time;
+		Time pass_start;
 		chrono::duration<float> delta_time;
 		chrono::duration<float> run_time;
 		thread main_thread;
+		std::atomic<bool> running{ false };	// the world thread runs until this goes false
 		mutex lock;
+		component_stats stats;
+		frame_histogram frames;
 
 	public:
-		float gravity = -9.8f;
+		float gravity = world_gravity().get_float();
 		bool use_thread;
 		std::string name;
 	public:
@@ -39,6 +62,7 @@ namespace trigger
 			use_thread = UseThread;
 			if (UseThread)
 			{
+				running = true;
 				main_thread = thread(&component_world::update, this, delta_time.count());
 			}
 		}
@@ -52,6 +76,7 @@ namespace trigger
 			use_thread = UseThread;
 			if (UseThread)
 			{
+				running = true;
 				main_thread = thread(&component_world::update, this, delta_time.count());
 			}
 		}
@@ -113,22 +138,41 @@ namespace trigger
 			return *i;
 		}
 
-		inline constexpr bool delete_component(component *target) noexcept
+		// Removes target from the world and deletes it.  False when target is
+		// not in this world.
+		inline bool delete_component(component *target) noexcept
 		{
-			if (target != nullptr && components.size() != 0)
+			if (target == nullptr)
 			{
-				lock.lock();
-				components.remove(target);
-				lock.unlock();
-				return true;
+				return false;
+			}
+
+			lock.lock();
+			auto found = std::find(components.begin(), components.end(), target);
+			bool owned = found != components.end();
+			if (owned)
+			{
+				components.erase(found);
+			}
+			lock.unlock();
+
+			if (owned)
+			{
+				delete target;
 			}
-			return false;
+			return owned;
 		}
 
-		//add component in world-component-list
-		inline constexpr void add(component * com) noexcept
+		// Adds com to the world, which deletes it.  Under the lock, the world
+		// thread may be walking the components.
+		inline void add(component * com) noexcept
 		{
-			if (com != nullptr) components.push_back(com);
+			if (com != nullptr)
+			{
+				lock.lock();
+				components.push_back(com);
+				lock.unlock();
+			}
 		}
 
 		inline void clean_component() noexcept
@@ -141,53 +185,108 @@ namespace trigger
 					if (!i->active) delete_list.push_back(i);
 				}
 
+				lock.lock();
 				for (auto i : delete_list)
 				{
 					components.remove(i);
 				}
+				lock.unlock();
+
+				for (auto i : delete_list)
+				{
+					delete i;
+				}
 			}
 		}
 
 		//simulating world
 		inline void update(float delta) noexcept
 		{
-			while (use_thread)
+			TRIGGER_PROFILE_THREAD("world");
+			while (running)
 			{
-				if (components.size() != 0)
+				if (component_count() != 0)
 				{
-					while (this->active)
+					while (this->active && running)
 					{
 						update_all();
 					}
+					// A pause is not a long pass.
+					pass_start = Time();
 				}
 			}
 		}
 
 		void update_all()
 		{
-			if (components.size() != 0)
+			TRIGGER_PROFILE_SCOPE("component_world::update_all");
+			alloc_scope heap(tag_world);
+			if (component_count() != 0)
 			{
-				run_time = chrono::duration_cast<chrono::duration<float>>(time::now() - start_time);
 				auto t = time::now();
+				run_time = chrono::duration_cast<chrono::duration<float>>(t - start_time);
+				float scale = time_scale * world_time_scale().get_float();
 				lock.lock();
+				stats.begin_pass();
 				for (auto i : components)
 				{
 					if (i != nullptr)
 					{
+						stats.count(*i);
 						if (i->active)
 						{
-							i->update(this->delta_time.count() * time_scale * i->time_scale);
+							auto begin = component_stats::ticks();
+							i->update(this->delta_time.count() * scale * i->time_scale);
+							stats.add(*i, component_stats::ticks() - begin);
 						}
 					}
 				}
 				lock.unlock();
+
+				// From the start of the last pass to the start of this one, waits included.
+				if (pass_start != Time())
+				{
+					frames.add(chrono::duration<double>(t - pass_start).count());
+				}
 				delta_time = chrono::duration_cast<chrono::duration<float>>(time::now() - t);
+				pass_start = t;
 			}
 		}
 
+		inline size_t component_count() noexcept
+		{
+			lock.lock();
+			size_t n = components.size();
+			lock.unlock();
+			return n;
+		}
+
+		// Pass times of the world, from the world thread or update_all's caller.
+		inline const frame_histogram &get_frames() const
+		{
+			return frames;
+		}
+
+		// Update cost per component type so far, most expensive first.
+		inline std::vector<component_stats::row> get_stats()
+		{
+			lock.lock();
+			auto rows = stats.report();
+			lock.unlock();
+			return rows;
+		}
+
+		inline void reset_stats()
+		{
+			lock.lock();
+			stats.reset();
+			lock.unlock();
+		}
+
 		//TODO
 		static bool save_world(string p, string n, component_world *w)
 		{
+			alloc_scope heap(tag_toml);
 			auto map = cpptoml::make_table();
 			auto set = cpptoml::make_table();
 			auto actors = cpptoml::make_table();
@@ -217,17 +316,18 @@ namespace trigger
 		//TODO
 		static inline component_world* load_world(string path)
 		{
+			alloc_scope heap(tag_toml);
 			auto map = cpptoml::parse_file(path);
 			auto set = cpptoml::make_table();
 			set = map->get_table("setting");
 			auto type = set->get_as<std::string>("type").value_or("unknown");
-			if (!type._Equal("map")) return nullptr;
+			if (type != "map") return nullptr;
 
 			auto com = set->get_table("trigger::component_world");
 			auto actors = cpptoml::make_table();
 
 			auto world = new component_world(set->get_as<bool>("use_thread").value_or(true));
-			world->gravity = (float)set->get_as<double>("gravity").value_or(-9.8f);
+			world->gravity = (float)set->get_as<double>("gravity").value_or(world_gravity().get_float());
 			world->name = set->get_as<std::string>("name").value_or("untitled");
 
 			auto super = com->get_table("trigger::component");
@@ -253,8 +353,18 @@ namespace trigger
 
 		~component_world()
 		{
+			// The world thread lets go of the components before they are deleted.
+			running = false;
+			if (main_thread.joinable())
+			{
+				main_thread.join();
+			}
+
+			for (auto i : components)
+			{
+				delete i;
+			}
 			components.clear();
-			main_thread.join();
 		}
 	};
 }
@@ -0,0 +1,326 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include "cpptoml.h"
+#include "alloc_tracker.h"
+
+namespace trigger
+{
+	// Where the cvars persist, next to imgui.ini.
+	const char *const cvar_config = "trigger.toml";
+
+	enum cvar_type
+	{
+		cvar_int,
+		cvar_float,
+		cvar_bool,
+		cvar_string,
+	};
+
+	enum cvar_flags : uint32_t
+	{
+		cvar_none = 0,
+		cvar_save = 1,		// written to the config by cvars::save()
+		cvar_restart = 2,	// read once at startup, a change waits for the next run
+	};
+
+	// A tunable, registered under its name for as long as it lives.
+	//
+	// Usually a static next to the code it tunes.  Any thread reads it
+	// without a lock: numbers are one atomic double, strings an atomic
+	// shared_ptr to an immutable copy, so a reader gets a whole old or a
+	// whole new value.  Sets come from the console, scripts and the config;
+	// version() moves on every one, for the code that has to react.
+	class cvar
+	{
+	public:
+		cvar(const char *name, int value, int low, int high, const char *help, uint32_t flags = cvar_save)
+			: cvar(name, cvar_int, (double)value, low, high, "", help, flags)
+		{}
+
+		cvar(const char *name, float value, float low, float high, const char *help, uint32_t flags = cvar_save)
+			: cvar(name, cvar_float, value, low, high, "", help, flags)
+		{}
+
+		cvar(const char *name, bool value, const char *help, uint32_t flags = cvar_save)
+			: cvar(name, cvar_bool, value ? 1.0 : 0.0, 0.0, 1.0, "", help, flags)
+		{}
+
+		cvar(const char *name, const char *value, const char *help, uint32_t flags = cvar_save)
+			: cvar(name, cvar_string, 0.0, 0.0, 0.0, value, help, flags)
+		{}
+
+		~cvar();
+
+		cvar(const cvar&) = delete;
+		cvar& operator=(const cvar&) = delete;
+
+		inline int get_int() const { return (int)number.load(std::memory_order_relaxed); }
+		inline float get_float() const { return (float)number.load(std::memory_order_relaxed); }
+		inline bool get_bool() const { return number.load(std::memory_order_relaxed) != 0.0; }
+		inline std::string get_string() const { return *std::atomic_load(&text_value); }
+		inline uint32_t version() const { return changes.load(std::memory_order_acquire); }
+
+		// Clamped to the range of the cvar.
+		void set(double v)
+		{
+			if (type == cvar_int || type == cvar_bool)
+				v = (double)(int64_t)v;
+			number.store(std::min<double>(std::max<double>(v, low), high), std::memory_order_relaxed);
+			changes.fetch_add(1, std::memory_order_release);
+		}
+
+		void set_string(const std::string &v)
+		{
+			std::atomic_store(&text_value, std::make_shared<const std::string>(v));
+			changes.fetch_add(1, std::memory_order_release);
+		}
+
+		// As typed in the console, false when it does not fit the type.
+		bool parse(const std::string &text)
+		{
+			const char *s = text.c_str();
+			char *end = nullptr;
+			switch (type)
+			{
+			case cvar_int:
+			{
+				long long v = strtoll(s, &end, 0);
+				if (text.empty() || *end != 0)
+					return false;
+				set((double)v);
+				return true;
+			}
+			case cvar_float:
+			{
+				double v = strtod(s, &end);
+				if (text.empty() || *end != 0)
+					return false;
+				set(v);
+				return true;
+			}
+			case cvar_bool:
+			{
+				std::string t;
+				for (char c : text)
+					t += (char)tolower((unsigned char)c);
+				if (t == "1" || t == "on" || t == "true")
+					set(1.0);
+				else if (t == "0" || t == "off" || t == "false")
+					set(0.0);
+				else
+					return false;
+				return true;
+			}
+			default:
+				set_string(text);
+				return true;
+			}
+		}
+
+		std::string to_string() const
+		{
+			char buf[64];
+			switch (type)
+			{
+			case cvar_int: snprintf(buf, sizeof(buf), "%d", get_int()); return buf;
+			case cvar_float: snprintf(buf, sizeof(buf), "%g", get_float()); return buf;
+			case cvar_bool: return get_bool() ? "true" : "false";
+			default: return get_string();
+			}
+		}
+
+		void reset()
+		{
+			if (type == cvar_string)
+				set_string(default_text);
+			else
+				set(default_number);
+		}
+
+		const std::string name;
+		const std::string help;
+		const cvar_type type;
+		const uint32_t flags;
+		const double low, high;
+
+	private:
+		std::atomic<double> number;
+		std::shared_ptr<const std::string> text_value;
+		std::atomic<uint32_t> changes;
+		double default_number;
+		std::string default_text;
+
+		cvar(const char *name, cvar_type type, double value, double low, double high, const char *text, const char *help, uint32_t flags);
+	};
+
+	// Every live cvar by name, and the config they persist to.
+	class cvars
+	{
+	public:
+		static cvar *find(const std::string &name)
+		{
+			auto &s = state();
+			std::lock_guard<std::mutex> l(s.lock);
+			auto found = s.vars.find(name);
+			return found != s.vars.end() ? found->second : nullptr;
+		}
+
+		// Sorted by name.
+		static std::vector<cvar*> list()
+		{
+			auto &s = state();
+			std::lock_guard<std::mutex> l(s.lock);
+			std::vector<cvar*> out;
+			for (auto &v : s.vars)
+				out.push_back(v.second);
+			return out;
+		}
+
+		// Sets the cvars found in the [cvars] table of path, and keeps the
+		// ones not registered yet for when they are, and for save().  False
+		// when it can't be read.
+		static bool load(const std::string &path, std::string &error)
+		{
+			alloc_scope heap(tag_toml);
+			std::shared_ptr<cpptoml::table> root;
+			try
+			{
+				root = cpptoml::parse_file(path);
+			}
+			catch (const cpptoml::parse_exception &e)
+			{
+				error = e.what();
+				return false;
+			}
+
+			auto table = root->get_table("cvars");
+			if (table == nullptr)
+				return true;
+
+			for (auto &entry : *table)
+			{
+				std::string text;
+				auto &v = entry.second;
+				if (auto i = v->as<int64_t>())
+					text = std::to_string(i->get());
+				else if (auto d = v->as<double>())
+					text = std::to_string(d->get());
+				else if (auto b = v->as<bool>())
+					text = b->get() ? "true" : "false";
+				else if (auto str = v->as<std::string>())
+					text = str->get();
+				else
+					continue;
+
+				if (auto c = find(entry.first))
+				{
+					c->parse(text);
+				}
+				else
+				{
+					auto &s = state();
+					std::lock_guard<std::mutex> l(s.lock);
+					s.pending[entry.first] = { text, v };
+				}
+			}
+			return true;
+		}
+
+		// Writes the cvar_save cvars to the [cvars] table of path, with the
+		// loaded ones nobody registered this run, so they are not lost.
+		static bool save(const std::string &path)
+		{
+			alloc_scope heap(tag_toml);
+			auto root = cpptoml::make_table();
+			auto table = cpptoml::make_table();
+			for (auto c : list())
+			{
+				if ((c->flags & cvar_save) == 0)
+					continue;
+				switch (c->type)
+				{
+				case cvar_int: table->insert(c->name, (int64_t)c->get_int()); break;
+				case cvar_float: table->insert(c->name, (double)c->get_float()); break;
+				case cvar_bool: table->insert(c->name, c->get_bool()); break;
+				default: table->insert(c->name, c->get_string()); break;
+				}
+			}
+			{
+				auto &s = state();
+				std::lock_guard<std::mutex> l(s.lock);
+				for (auto &p : s.pending)
+					table->insert(p.first, p.second.value);
+			}
+			root->insert("cvars", table);
+
+			std::ofstream o(path);
+			if (!o.is_open())
+				return false;
+			o << *root;
+			return o.good();
+		}
+
+	private:
+		friend class cvar;
+
+		struct shared
+		{
+			struct loaded
+			{
+				std::string text;
+				std::shared_ptr<cpptoml::base> value;	// as read, to be written back
+			};
+
+			std::mutex lock;
+			std::map<std::string, cvar*> vars;
+			std::map<std::string, loaded> pending;	// loaded before they were registered
+		};
+
+		// A function static, so cvars can be statics of any translation unit.
+		static shared &state()
+		{
+			static shared s;
+			return s;
+		}
+	};
+
+	inline cvar::cvar(const char *name, cvar_type type, double value, double low, double high, const char *text, const char *help, uint32_t flags)
+		: name(name), help(help), type(type), flags(flags), low(low), high(high),
+		number(value), text_value(std::make_shared<const std::string>(text)), changes(0), default_number(value), default_text(text)
+	{
+		std::string loaded;
+		bool was_loaded = false;
+		{
+			auto &s = cvars::state();
+			std::lock_guard<std::mutex> l(s.lock);
+			s.vars[this->name] = this;
+			auto found = s.pending.find(this->name);
+			if (found != s.pending.end())
+			{
+				loaded = found->second.text;
+				was_loaded = true;
+				s.pending.erase(found);
+			}
+		}
+		// Set by a config loaded before it was registered.
+		if (was_loaded)
+			parse(loaded);
+	}
+
+	inline cvar::~cvar()
+	{
+		auto &s = cvars::state();
+		std::lock_guard<std::mutex> l(s.lock);
+		s.vars.erase(name);
+	}
+}
@@ -3,6 +3,8 @@
 //***************************************************************************************
 
 #include "d3dApp.h"
+#include "profiler.h"
+#include "alloc_tracker.h"
 #include <WindowsX.h>
 
 using Microsoft::WRL::ComPtr;
@@ -74,6 +76,7 @@ int D3DApp::Run()
 	MSG msg = { 0 };
 
 	mTimer.Reset();
+	TRIGGER_PROFILE_THREAD("main");
 
 	while (msg.message != WM_QUIT)
 	{
@@ -98,6 +101,8 @@ int D3DApp::Run()
 				elapsedTicks = mTimer.DeltaTime() - (float)currentTicks;
 				currentTicks += elapsedTicks;
 
+				TRIGGER_PROFILE_FRAME();
+				trigger::alloc_tracker::frame();
 				CalculateFrameStats();
 				Update(mTimer);
 				Draw(mTimer);
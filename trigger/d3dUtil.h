@@ -39,7 +39,7 @@
 #include "actor.h"
 
 
-extern const int gNumFrameResources;
+extern int gNumFrameResources;
 
 inline void d3dSetDebugName(IDXGIObject* obj, const char* name)
 {
@@ -155,6 +155,9 @@ struct MeshGeometry
 	Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferUploader = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferUploader = nullptr;
 
+	// False while the buffers are still being streamed in; do not draw it yet.
+	bool Resident = true;
+
     // Data about the buffers.
 	UINT VertexByteStride = 0;
 	UINT VertexBufferByteSize = 0;
@@ -218,6 +221,8 @@ struct MaterialConstants
 
 // Simple struct to represent a material for our demos.  A production 3D engine
 // would likely create a class hierarchy of Materials.
+struct Texture;
+
 struct Material
 {
 	// Unique material name for lookup.
@@ -229,6 +234,10 @@ struct Material
 	// Index into SRV heap for diffuse texture.
 	int DiffuseSrvHeapIndex = -1;
 
+	// Streamed diffuse texture.  Its SrvHeapIndex moves as mips come and go,
+	// so when set it is used instead of DiffuseSrvHeapIndex.
+	Texture* DiffuseMap = nullptr;
+
 	// Index into SRV heap for normal texture.
 	int NormalSrvHeapIndex = -1;
 
@@ -254,6 +263,27 @@ struct Texture
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap = nullptr;
+
+	// Mip residency, kept by TextureStreamer.  Resource holds mips [ResidentMip, MipCount)
+	// of the file and is null until the first of them have arrived.
+	UINT Width = 0;
+	UINT Height = 0;
+	UINT MipCount = 0;
+	UINT ResidentMip = 0;
+
+	// Bytes of each mip of the file, all array slices.
+	std::vector<UINT64> MipBytes;
+
+	// Index into SRV heap of the view of Resource.
+	UINT SrvHeapIndex = 0;
+
+	UINT64 ResidentBytes()const
+	{
+		UINT64 bytes = 0;
+		for (UINT i = ResidentMip; Resource != nullptr && i < MipCount; ++i)
+			bytes += MipBytes[i];
+		return bytes;
+	}
 };
 
 #ifndef ThrowIfFailed
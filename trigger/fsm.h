@@ -2,7 +2,9 @@
 #include <thread>
 #include <string>
 #include <list>
+#include <algorithm>
 #include "component.h"
+#include "profiler.h"
 #include <iostream>
 #include <memory>
 
@@ -10,7 +12,7 @@ namespace trigger
 {
 	namespace fsm
 	{
-		class state
+		class state : public trigger::tracked<tag_fsm>
 		{
 			const std::string name;
 		public:
@@ -29,13 +31,17 @@ namespace trigger
 			{};
 			virtual void update(const float delta)
 			{};
+
+			virtual ~state()
+			{}
 		};
 
-		class link
+		// Between two states of a map, which owns all three.
+		class link : public trigger::tracked<tag_fsm>
 		{
 		private:
-			std::unique_ptr<state> cur;
-			std::unique_ptr<state> next;
+			const state *cur;
+			const state *next;
 			int ops;
 
 		public:
@@ -48,17 +54,17 @@ namespace trigger
 
 			explicit inline link(const state *current, const state *next) : link()
 			{
-				this->cur._Myptr() = const_cast<state*>(current);
-				this->next._Myptr() = const_cast<state*>(next);
+				this->cur = current;
+				this->next = next;
 			}
 
 			inline const state* get_current_state() const noexcept
 			{
-				return this->cur.get();
+				return this->cur;
 			};
 			inline const state* get_next_state() const noexcept
 			{
-				return this->next.get();
+				return this->next;
 			};
 			inline constexpr const int& get_ops() const noexcept
 			{
@@ -70,16 +76,18 @@ namespace trigger
 			};
 		};
 
+		// Owns its states and links: the ones added to it are deleted with it.
 		class map : public component
 		{
 		private:
-			std::unique_ptr<state> now_state;
+			state *now_state;
 			std::list<state*> states;
 			std::list<link*> links;
 			std::string cur_name, now_name;
 
 			inline void simulate(float delta) noexcept
 			{
+				TRIGGER_PROFILE_SCOPE("fsm::map::simulate");
 				now_state->update(delta);
 				for(auto i : this->links)
 				{
@@ -91,7 +99,7 @@ namespace trigger
 						{
 							i->set_ops(i->get_ops() + 1);
 							now_state->end_state();
-							now_state._Myptr() = const_cast<state*>(i->get_next_state());
+							now_state = const_cast<state*>(i->get_next_state());
 							now_state->begin_state();
 							now_name = now_state->get_name();
 							return;
@@ -108,15 +116,18 @@ namespace trigger
 
 				auto idle = new state("idle");
 				add_state(idle);
-				now_state = std::make_unique<state>(idle->get_name());
+				now_state = idle;
 				now_name = now_state->get_name();
 			}
 
+			map(const map&) = delete;
+			map& operator=(const map&) = delete;
+
 			inline explicit map(state *def_state) : map()
 			{
 				// inited state idle
 				add_state(def_state);
-				link *def = new link(now_state.get(), def_state);
+				link *def = new link(now_state, def_state);
 				def->set_ops(0);
 				links.push_back(def);
 				now_name = now_state->get_name();
@@ -159,6 +170,21 @@ namespace trigger
 				return false;
 			}
 
+			// Arms the link from state1 to state2: the next update() in state1
+			// moves along it.
+			inline bool trigger_link(const std::string state1, const std::string state2) noexcept
+			{
+				for(auto i : links)
+				{
+					if(i->get_current_state()->get_name() == state1 && i->get_next_state()->get_name() == state2)
+					{
+						i->set_ops(0);
+						return true;
+					}
+				}
+				return false;
+			}
+
 			inline const state& get_now_state() const noexcept
 			{
 				return *now_state;
@@ -181,11 +207,31 @@ namespace trigger
 				}
 			}
 
+			// The current state stays, and so do states of other maps.  The links
+			// from and to state go with it.
 			inline bool delete_state(state * state) noexcept
 			{
-				if(state != nullptr)
+				if(state == nullptr || state == now_state)
+				{
+					return false;
+				}
+				auto found = std::find(states.begin(), states.end(), state);
+				if(found != states.end())
 				{
-					states.remove(state);
+					states.erase(found);
+					for(auto i = links.begin(); i != links.end();)
+					{
+						if((*i)->get_current_state() == state || (*i)->get_next_state() == state)
+						{
+							delete *i;
+							i = links.erase(i);
+						}
+						else
+						{
+							++i;
+						}
+					}
+					delete state;
 					return true;
 				}
 				return false;
@@ -223,6 +269,7 @@ namespace trigger
 				if(t != nullptr)
 				{
 					links.remove(const_cast<link*>(t));
+					delete t;
 					return true;
 				}
 				return false;
@@ -254,13 +301,16 @@ namespace trigger
 
 			~map()
 			{
-				if(now_state != nullptr)
+				for(auto i : links)
 				{
-					now_state.release();
+					delete i;
+				}
+				for(auto i : states)
+				{
+					delete i;
 				}
-
-				states.clear();
 				links.clear();
+				states.clear();
 			}
 
 		};
@@ -0,0 +1,189 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "log_ring.h"
+
+namespace trigger
+{
+	// Binary capture of log records, written as they come out of the ring and
+	// decoded offline with log_file::decode().
+	//
+	// "TLOG", u32 version, then entries starting with a kind byte:
+	//   format : u32 id, u16 length, the format string.  Before its first use.
+	//   record : u64 time_us, u32 thread, u8 severity, u8 tag length, the tag,
+	//            u32 format id (no_format when formatted), u8 length, the
+	//            text or the encoded arguments (see log_arg_type).
+	// Numbers are little endian, like the machines it runs on.
+	class log_file
+	{
+	public:
+		static const uint32_t version = 1;
+		static const uint32_t no_format = 0xffffffff;
+
+		enum kind : uint8_t
+		{
+			kind_format,
+			kind_record,
+		};
+
+		log_file() {}
+		log_file(const log_file&) = delete;
+		log_file& operator=(const log_file&) = delete;
+
+		~log_file()
+		{
+			close();
+		}
+
+		bool open(const char *path)
+		{
+			close();
+			file = fopen(path, "wb");
+			if (file == nullptr)
+				return false;
+			fwrite("TLOG", 1, 4, file);
+			put(version);
+			return true;
+		}
+
+		void close()
+		{
+			if (file != nullptr)
+				fclose(file);
+			file = nullptr;
+			formats.clear();
+		}
+
+		bool is_open() const
+		{
+			return file != nullptr;
+		}
+
+		void write(const log_record &r)
+		{
+			if (file == nullptr)
+				return;
+
+			uint32_t id = no_format;
+			if (r.format != nullptr)
+			{
+				auto found = formats.find(r.format);
+				if (found != formats.end())
+				{
+					id = found->second;
+				}
+				else
+				{
+					id = (uint32_t)formats.size();
+					formats[r.format] = id;
+					uint16_t len = (uint16_t)std::min<size_t>(strlen(r.format), 0xffff);
+					put((uint8_t)kind_format);
+					put(id);
+					put(len);
+					fwrite(r.format, 1, len, file);
+				}
+			}
+
+			uint8_t tag_len = (uint8_t)strlen(r.tag);
+			uint8_t len = r.format != nullptr ? r.arg_bytes : (uint8_t)strlen(r.text);
+			put((uint8_t)kind_record);
+			put(r.time_us);
+			put(r.thread);
+			put((uint8_t)r.severity);
+			put(tag_len);
+			fwrite(r.tag, 1, tag_len, file);
+			put(id);
+			put(len);
+			fwrite(r.text, 1, len, file);
+		}
+
+		// Calls line(record, text) for every record of the file at path, false
+		// when it is not a log file or ends early.
+		template<typename Line>
+		static bool decode(const char *path, Line line)
+		{
+			FILE *in = fopen(path, "rb");
+			if (in == nullptr)
+				return false;
+
+			char magic[4];
+			uint32_t file_version = 0;
+			bool ok = fread(magic, 1, 4, in) == 4 && memcmp(magic, "TLOG", 4) == 0 &&
+				get(in, file_version) && file_version == version;
+
+			std::vector<std::string> table;
+			uint8_t k;
+			while (ok && get(in, k))
+			{
+				if (k == kind_format)
+				{
+					uint32_t id;
+					uint16_t len;
+					ok = get(in, id) && get(in, len);
+					std::string format(len, 0);
+					ok = ok && fread(&format[0], 1, len, in) == len;
+					if (ok)
+					{
+						if (table.size() <= id)
+							table.resize(id + 1);
+						table[id] = format;
+					}
+				}
+				else if (k == kind_record)
+				{
+					log_record r = {};
+					uint8_t severity, tag_len, len;
+					uint32_t id;
+					ok = get(in, r.time_us) && get(in, r.thread) && get(in, severity) && get(in, tag_len) &&
+						tag_len < sizeof(r.tag) && fread(r.tag, 1, tag_len, in) == tag_len &&
+						get(in, id) && get(in, len) && len <= sizeof(r.text) && fread(r.text, 1, len, in) == len;
+					if (ok)
+					{
+						r.severity = (log_severity)severity;
+						if (id != no_format)
+						{
+							ok = id < table.size();
+							r.format = ok ? table[id].c_str() : nullptr;
+							r.arg_bytes = len;
+						}
+						else if (len == sizeof(r.text))
+						{
+							r.text[len - 1] = 0;
+						}
+					}
+					if (ok)
+					{
+						char text[1024];
+						format_record(r, text, sizeof(text));
+						line(r, text);
+					}
+				}
+				else
+				{
+					ok = false;
+				}
+			}
+			ok = ok && feof(in);
+			fclose(in);
+			return ok;
+		}
+
+	private:
+		FILE *file = nullptr;
+		std::unordered_map<const char*, uint32_t> formats;
+
+		template<typename T>
+		void put(T v)
+		{
+			fwrite(&v, sizeof(T), 1, file);
+		}
+
+		template<typename T>
+		static bool get(FILE *in, T &v)
+		{
+			return fread(&v, sizeof(T), 1, in) == 1;
+		}
+	};
+}
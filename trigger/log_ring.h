@@ -0,0 +1,375 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cstring>
+#include <cstdarg>
+#include <string>
+#include <type_traits>
+
+namespace trigger
+{
+	enum log_severity : uint8_t
+	{
+		log_info,
+		log_warning,
+		log_error,
+	};
+
+	// One line, copied whole into and out of the ring.  It is either formatted
+	// already, or the format string and its arguments, formatted by whoever
+	// reads it: format_record().
+	struct log_record
+	{
+		uint64_t time_us;	// since the ring was made
+		uint32_t thread;
+		log_severity severity;
+		uint8_t arg_bytes;	// used bytes of text when format is set
+		char tag[10];		// "lua", "cmd"..., empty for none
+		const char *format;	// a string literal, nullptr when text is formatted
+		char text[240];		// formatted text, or the encoded arguments of format
+	};
+
+	// Arguments of a deferred record, one type byte and the value each.
+	// Strings are copied, truncated to what is left of the record.
+	enum log_arg_type : uint8_t
+	{
+		log_arg_int,		// int64_t
+		log_arg_uint,		// uint64_t
+		log_arg_double,
+		log_arg_pointer,
+		log_arg_string,		// length byte, then the bytes
+	};
+
+	struct log_arg_writer
+	{
+		char *p;
+		char *end;
+
+		template<typename T>
+		typename std::enable_if<std::is_integral<T>::value>::type put(T v)
+		{
+			if (std::is_signed<T>::value)
+				raw(log_arg_int, (int64_t)v);
+			else
+				raw(log_arg_uint, (uint64_t)v);
+		}
+
+		template<typename T>
+		typename std::enable_if<std::is_floating_point<T>::value>::type put(T v)
+		{
+			raw(log_arg_double, (double)v);
+		}
+
+		template<typename T>
+		void put(T *v)
+		{
+			raw(log_arg_pointer, (uint64_t)(uintptr_t)v);
+		}
+
+		void put(char *v) { put((const char*)v); }
+		void put(const std::string &v) { put(v.c_str()); }
+
+		void put(const char *v)
+		{
+			if (end - p < 2)
+			{
+				p = end;
+				return;
+			}
+			size_t len = strlen(v != nullptr ? v : "(null)");
+			len = std::min<size_t>(std::min<size_t>(len, 255), end - p - 2);
+			*p++ = (char)log_arg_string;
+			*p++ = (char)len;
+			memcpy(p, v != nullptr ? v : "(null)", len);
+			p += len;
+		}
+
+		template<typename V>
+		void raw(log_arg_type type, V v)
+		{
+			if (end - p < (ptrdiff_t)(1 + sizeof(V)))
+			{
+				p = end;
+				return;
+			}
+			*p++ = (char)type;
+			memcpy(p, &v, sizeof(V));
+			p += sizeof(V);
+		}
+
+		void all() {}
+
+		template<typename First, typename... Rest>
+		void all(const First &first, const Rest&... rest)
+		{
+			put(first);
+			all(rest...);
+		}
+	};
+
+	// Text of r into out: printf of its format over its arguments, each
+	// conversion taking the next one.  Missing arguments print as "?".
+	inline void format_record(const log_record &r, char *out, size_t size)
+	{
+		if (r.format == nullptr)
+		{
+			snprintf(out, size, "%s", r.text);
+			return;
+		}
+
+		const char *arg = r.text;
+		const char *args_end = r.text + r.arg_bytes;
+		char *o = out;
+		char *o_end = out + size - 1;
+		for (const char *f = r.format; *f != 0 && o < o_end; )
+		{
+			if (*f != '%' || f[1] == '%')
+			{
+				*o++ = *f;
+				f += (*f == '%') ? 2 : 1;
+				continue;
+			}
+
+			// One conversion, without its length modifiers.
+			char spec[32];
+			size_t n = 0;
+			spec[n++] = *f++;
+			while (*f != 0 && strchr("-+ #0123456789.*hlLjzt", *f) != nullptr)
+			{
+				if (strchr("hlLjzt", *f) == nullptr && n < sizeof(spec) - 5)
+					spec[n++] = *f;
+				f++;
+			}
+			char conv = *f;
+			if (conv == 0)
+				break;
+			f++;
+
+			int written = 0;
+			size_t room = (size_t)(o_end - o) + 1;
+			log_arg_type type = arg < args_end ? (log_arg_type)*arg : log_arg_string;
+			if (arg >= args_end)
+			{
+				written = snprintf(o, room, "?");
+			}
+			else if (type == log_arg_string)
+			{
+				size_t len = (unsigned char)arg[1];
+				spec[n++] = '.';
+				spec[n++] = '*';
+				spec[n++] = 's';
+				spec[n] = 0;
+				written = snprintf(o, room, spec, (int)len, arg + 2);
+				arg += 2 + len;
+			}
+			else
+			{
+				uint64_t bits;
+				memcpy(&bits, arg + 1, sizeof(bits));
+				arg += 1 + sizeof(bits);
+				if (type == log_arg_double)
+				{
+					double d;
+					memcpy(&d, &bits, sizeof(d));
+					spec[n++] = strchr("eEfFgGaA", conv) != nullptr ? conv : 'g';
+					spec[n] = 0;
+					written = snprintf(o, room, spec, d);
+				}
+				else if (type == log_arg_pointer || conv == 'p')
+				{
+					spec[n++] = 'p';
+					spec[n] = 0;
+					written = snprintf(o, room, spec, (void*)(uintptr_t)bits);
+				}
+				else if (conv == 'c')
+				{
+					spec[n++] = 'c';
+					spec[n] = 0;
+					written = snprintf(o, room, spec, (int)bits);
+				}
+				else
+				{
+					spec[n++] = 'l';
+					spec[n++] = 'l';
+					spec[n++] = strchr("diouxX", conv) != nullptr ? conv : (type == log_arg_int ? 'd' : 'u');
+					spec[n] = 0;
+					if (type == log_arg_int)
+						written = snprintf(o, room, spec, (long long)(int64_t)bits);
+					else
+						written = snprintf(o, room, spec, (unsigned long long)bits);
+				}
+			}
+			if (written > 0)
+				o += std::min<size_t>((size_t)written, room - 1);
+		}
+		*o = 0;
+	}
+
+	// Bounded multi producer, multi consumer queue of log records.
+	//
+	// Every cell carries a sequence number that tells whether it is free for
+	// the producer of a given turn or full for the consumer of that turn, so
+	// producers and consumers only race on one atomic counter each and never
+	// wait on one another.  A push never blocks or allocates: when the ring is
+	// full the record is dropped and counted, the consumer is expected to
+	// drain every frame.  capacity is rounded up to a power of two.
+	class log_ring
+	{
+	public:
+		explicit log_ring(size_t capacity)
+			: cells(round_up(capacity)), mask(cells.size() - 1)
+		{
+			for (size_t i = 0; i < cells.size(); ++i)
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+			start = std::chrono::steady_clock::now();
+		}
+
+		log_ring(const log_ring&) = delete;
+		log_ring& operator=(const log_ring&) = delete;
+
+		bool push(log_severity severity, const char *tag, const char *fmt, ...)
+		{
+			va_list args;
+			va_start(args, fmt);
+			bool pushed = pushv(severity, tag, fmt, args);
+			va_end(args);
+			return pushed;
+		}
+
+		bool pushv(log_severity severity, const char *tag, const char *fmt, va_list args)
+		{
+			cell *c = begin(severity, tag);
+			if (c == nullptr)
+				return false;
+
+			c->record.format = nullptr;
+			vsnprintf(c->record.text, sizeof(c->record.text), fmt, args);
+			commit(c);
+			return true;
+		}
+
+		// Keeps fmt, which must be a string literal, and the raw arguments:
+		// no formatting on the calling thread.
+		template<typename... Args>
+		bool push_deferred(log_severity severity, const char *tag, const char *fmt, const Args&... args)
+		{
+			cell *c = begin(severity, tag);
+			if (c == nullptr)
+				return false;
+
+			log_arg_writer w = { c->record.text, c->record.text + sizeof(c->record.text) };
+			w.all(args...);
+			c->record.format = fmt;
+			c->record.arg_bytes = (uint8_t)(w.p - c->record.text);
+			commit(c);
+			return true;
+		}
+
+		// Oldest record into out, false when the ring is empty.
+		bool pop(log_record &out)
+		{
+			cell *c = claim(head, 1);
+			if (c == nullptr)
+				return false;
+
+			out = c->record;
+			c->sequence.store(c->turn + mask + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Records lost to a full ring so far.
+		uint64_t dropped_count() const
+		{
+			return dropped.load(std::memory_order_relaxed);
+		}
+
+		size_t capacity() const
+		{
+			return mask + 1;
+		}
+
+	private:
+		struct cell
+		{
+			std::atomic<size_t> sequence;
+			size_t turn;
+			log_record record;
+		};
+
+		static size_t round_up(size_t capacity)
+		{
+			size_t size = 2;
+			while (size < capacity)
+				size *= 2;
+			return size;
+		}
+
+		cell *begin(log_severity severity, const char *tag)
+		{
+			cell *c = claim(tail, 0);
+			if (c == nullptr)
+			{
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return nullptr;
+			}
+
+			log_record &r = c->record;
+			r.time_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+			r.thread = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+			r.severity = severity;
+			r.arg_bytes = 0;
+			strncpy(r.tag, tag != nullptr ? tag : "", sizeof(r.tag) - 1);
+			r.tag[sizeof(r.tag) - 1] = 0;
+			return c;
+		}
+
+		void commit(cell *c)
+		{
+			c->sequence.store(c->turn + 1, std::memory_order_release);
+		}
+
+		// Takes the cell at position for this side, or nullptr when it is not
+		// ready: full for producers (ready = 0), empty for consumers (ready = 1).
+		cell *claim(std::atomic<size_t> &position, size_t ready)
+		{
+			size_t pos = position.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				cell &c = cells[pos & mask];
+				size_t seq = c.sequence.load(std::memory_order_acquire);
+				intptr_t diff = (intptr_t)seq - (intptr_t)(pos + ready);
+				if (diff == 0)
+				{
+					if (position.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						c.turn = pos;
+						return &c;
+					}
+				}
+				else if (diff < 0)
+				{
+					return nullptr;
+				}
+				else
+				{
+					pos = position.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		std::vector<cell> cells;
+		size_t mask;
+		std::chrono::steady_clock::time_point start;
+
+		// Apart, so producers and the consumer do not share a cache line.
+		alignas(64) std::atomic<size_t> tail{ 0 };
+		alignas(64) std::atomic<size_t> head{ 0 };
+		alignas(64) std::atomic<uint64_t> dropped{ 0 };
+	};
+}
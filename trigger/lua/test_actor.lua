@@ -1,12 +1,23 @@
 -- t_actor : component name matching this lua file
--- t_move ( actor ,  0, 0, 0 )
--- t_position( actor , 0, 0, 0)
--- t_set_scale( actor , 0, 0, 0)
--- t_rotation( actor , 0, 0, 0 )
--- t_set_rotation( actor , 0, 0, 0)
--- t_kill( actor ) 
--- t_new_actor( "name" ) -> return "name"
+-- self : handle of the actor running this file. Every actor runs its own copy,
+--        so globals defined here are private to it.
+-- actor : handle from self or t_new_actor. Handles of deleted actors go stale,
+--         actor:valid() tells. Names still work where a handle is expected.
+-- t_move ( actor ,  0, 0, 0 )				actor:move(0, 0, 0)
+-- t_set_position( actor , 0, 0, 0)		actor:set_position(0, 0, 0)
+-- t_set_scale( actor , 0, 0, 0)			actor:set_scale(0, 0, 0)
+-- t_rotation( actor , 0, 0, 0 )			actor:rotate(0, 0, 0)
+-- t_set_rotation( actor , 0, 0, 0)		actor:set_rotation(0, 0, 0)
+-- actor.position, actor.rotation, actor.scale : { x, y, z }, read and write
+-- actor.name
+-- t_new_actor( "name" ) -> return actor
+-- t_find_actors( "prefix" ) -> { actor, ... } whose name starts with prefix
+-- t_move_all( actors, xs, ys, zs ), t_rotate_all, t_set_position_all,
+-- t_set_rotation_all, t_set_scale_all : one call for a whole group. xs, ys, zs
+--        are arrays parallel to actors, or numbers for all of them.
 -- t_print("message")
+-- Changes to actors (setters, fields, t_new_actor) are applied at the end of
+-- the tick, so reads in the same update still see the old values.
 
 function init() --init lua
 	t_print("Hello")
@@ -17,3 +28,8 @@ end
 
 function destroy() --When Destroy
 end
+
+-- Saving this file reloads it in place: the functions are replaced and the
+-- globals keep their values, so init() does not run again. Write state as
+-- count = count or 0 to keep it across reloads. reload(), when defined, is
+-- called after every reload.
@@ -0,0 +1,279 @@
+#pragma once
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include "alloc_tracker.h"
+
+namespace trigger
+{
+	// Allocator of the lua VM, for lua_newstate.
+	//
+	// Blocks up to max_pooled bytes come from free lists of 16 byte size classes,
+	// carved out of 64KB pages that are kept for reuse, so the many small tables,
+	// strings and closures of the scripts do not fragment the process heap.
+	// Bigger blocks go to malloc.  Both are reported to the alloc_tracker
+	// under tag_lua, pages as they are added and big blocks one by one.
+	//
+	// Every block starts with the id of the owner it was allocated for: the
+	// script running at the time, or 0 for everything else.  Live bytes and
+	// totals are kept per owner, and an owner with a budget is refused the
+	// allocations that would take it over, which lua raises as a memory error
+	// in that script.  The owner of a script that is gone is removed: what it
+	// left live counts as shared, and its id is reused once that is freed.
+	class lua_allocator
+	{
+	public:
+		struct owner
+		{
+			size_t live = 0;
+			size_t peak = 0;
+			size_t budget = 0;		// 0 is no limit
+			uint64_t allocated = 0;	// bytes, running totals
+			uint64_t freed = 0;
+			uint64_t refused = 0;	// allocations over the budget
+			bool removed = false;	// its blocks wait to be freed, then the id is reused
+		};
+
+		static const size_t page_size = 64 * 1024;
+		static const size_t max_pooled = 512;
+
+		// Owner charged for the blocks allocated from now on.
+		unsigned int current = 0;
+
+		lua_allocator()
+		{
+			owners.resize(1);
+		}
+
+		lua_allocator(const lua_allocator&) = delete;
+		lua_allocator& operator=(const lua_allocator&) = delete;
+
+		~lua_allocator()
+		{
+			for (auto p : pages)
+			{
+				free(p);
+				alloc_tracker::remove(tag_lua, page_size);
+			}
+			alloc_tracker::resize(tag_lua, -(int64_t)big_bytes);
+		}
+
+		// lua_Alloc, ud is the allocator.
+		static void *alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+		{
+			return ((lua_allocator*)ud)->reallocate(ptr, osize, nsize);
+		}
+
+		inline unsigned int add_owner(size_t budget)
+		{
+			unsigned int id;
+			if (!free_ids.empty())
+			{
+				id = free_ids.back();
+				free_ids.pop_back();
+				owners[id] = owner();
+			}
+			else
+			{
+				id = (unsigned int)owners.size();
+				owners.push_back(owner());
+			}
+			owners[id].budget = budget;
+			return id;
+		}
+
+		// The script of id is gone.  Its live blocks count as shared from now on.
+		inline void remove_owner(unsigned int id)
+		{
+			if (id == 0 || owners[id].removed)
+				return;
+			owners[id].removed = true;
+			owners[id].budget = 0;
+			if (owners[id].live == 0)
+				free_ids.push_back(id);
+		}
+
+		// Live bytes of no script: owner 0 and the owners removed.
+		inline size_t shared_bytes() const
+		{
+			size_t live = 0;
+			for (size_t i = 0; i < owners.size(); ++i)
+			{
+				if (i == 0 || owners[i].removed)
+					live += owners[i].live;
+			}
+			return live;
+		}
+
+		inline owner &get(unsigned int id)
+		{
+			return owners[id];
+		}
+
+		inline size_t pooled_bytes() const
+		{
+			return pages.size() * page_size;
+		}
+
+		inline size_t heap_bytes() const
+		{
+			return big_bytes;
+		}
+
+	private:
+		// 8 bytes, so blocks keep the 8 byte alignment lua needs.
+		struct header
+		{
+			uint32_t owner;
+			uint32_t size_class;
+		};
+
+		struct free_block
+		{
+			free_block *next;
+		};
+
+		static const uint32_t big = 0xffffffff;
+		static const size_t class_count = max_pooled / 16;
+
+		std::vector<owner> owners;
+		std::vector<unsigned int> free_ids;
+		std::vector<void*> pages;
+		free_block *free_lists[class_count] = {};
+		size_t big_bytes = 0;
+
+		static inline uint32_t class_of(size_t size)
+		{
+			size_t total = size + sizeof(header);
+			return total <= max_pooled ? (uint32_t)((total + 15) / 16 - 1) : big;
+		}
+
+		void *reallocate(void *ptr, size_t osize, size_t nsize)
+		{
+			if (nsize == 0)
+			{
+				if (ptr != nullptr)
+					release(ptr, osize);
+				return nullptr;
+			}
+
+			// For a new block osize is the lua type of the object.
+			if (ptr == nullptr)
+				return acquire(current, nsize, true);
+
+			header *h = (header*)ptr - 1;
+			owner &o = owners[h->owner];
+			if (h->size_class != big && h->size_class == class_of(nsize))
+			{
+				// Still fits its size class, nothing moves.
+				if (nsize > osize && o.budget != 0 && o.live + nsize - osize > o.budget)
+				{
+					o.refused++;
+					return nullptr;
+				}
+				o.live = o.live + nsize - osize;
+				o.peak = std::max<size_t>(o.peak, o.live);
+				return ptr;
+			}
+
+			// The block stays charged to its owner.
+			void *n = acquire(h->owner, nsize, nsize > osize);
+			if (n == nullptr)
+			{
+				// lua counts on shrinking to never fail.
+				if (nsize < osize)
+				{
+					o.live -= osize - nsize;
+					if (h->size_class == big)
+					{
+						big_bytes -= osize - nsize;
+						alloc_tracker::resize(tag_lua, -(int64_t)(osize - nsize));
+					}
+					return ptr;
+				}
+				return nullptr;
+			}
+			memcpy(n, ptr, std::min<size_t>(osize, nsize));
+			release(ptr, osize);
+			return n;
+		}
+
+		void *acquire(unsigned int id, size_t size, bool check_budget)
+		{
+			owner &o = owners[id];
+			if (check_budget && o.budget != 0 && o.live + size > o.budget)
+			{
+				o.refused++;
+				return nullptr;
+			}
+
+			header *h = nullptr;
+			uint32_t c = class_of(size);
+			if (c != big)
+			{
+				if (free_lists[c] == nullptr && !add_page(c))
+					return nullptr;
+				h = (header*)free_lists[c];
+				free_lists[c] = free_lists[c]->next;
+			}
+			else
+			{
+				h = (header*)malloc(size + sizeof(header));
+				if (h == nullptr)
+					return nullptr;
+				big_bytes += size + sizeof(header);
+				alloc_tracker::add(tag_lua, size + sizeof(header));
+			}
+
+			h->owner = id;
+			h->size_class = c;
+			o.live += size;
+			o.peak = std::max<size_t>(o.peak, o.live);
+			o.allocated += size;
+			return h + 1;
+		}
+
+		void release(void *ptr, size_t size)
+		{
+			header *h = (header*)ptr - 1;
+			owner &o = owners[h->owner];
+			o.live -= size;
+			o.freed += size;
+			if (o.removed && o.live == 0)
+				free_ids.push_back(h->owner);
+
+			if (h->size_class == big)
+			{
+				big_bytes -= size + sizeof(header);
+				alloc_tracker::remove(tag_lua, size + sizeof(header));
+				free(h);
+				return;
+			}
+
+			uint32_t c = h->size_class;
+			auto b = (free_block*)h;
+			b->next = free_lists[c];
+			free_lists[c] = b;
+		}
+
+		bool add_page(uint32_t c)
+		{
+			char *page = (char*)malloc(page_size);
+			if (page == nullptr)
+				return false;
+			pages.push_back(page);
+			alloc_tracker::add(tag_lua, page_size);
+
+			size_t block = (c + 1) * 16;
+			for (size_t offset = 0; offset + block <= page_size; offset += block)
+			{
+				auto b = (free_block*)(page + offset);
+				b->next = free_lists[c];
+				free_lists[c] = b;
+			}
+			return true;
+		}
+	};
+}
@@ -0,0 +1,362 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <algorithm>
+#include "imgui.h"
+#include "trigger_clock.h"
+
+// 0 compiles every TRIGGER_PROFILE_* macro out.
+#ifndef TRIGGER_PROFILE
+#define TRIGGER_PROFILE 1
+#endif
+
+#define TRIGGER_PROFILE_CAT2(a, b) a##b
+#define TRIGGER_PROFILE_CAT(a, b) TRIGGER_PROFILE_CAT2(a, b)
+
+#if TRIGGER_PROFILE
+// Times the rest of the enclosing block.  name must be a string literal.
+#define TRIGGER_PROFILE_SCOPE(name) trigger::profile_scope TRIGGER_PROFILE_CAT(profile_scope_, __LINE__)(name)
+// Start of a frame, on the main thread.
+#define TRIGGER_PROFILE_FRAME() trigger::profiler::frame()
+// Lane name of the calling thread in the timeline.
+#define TRIGGER_PROFILE_THREAD(name) trigger::profiler::set_thread_name(name)
+#else
+#define TRIGGER_PROFILE_SCOPE(name)
+#define TRIGGER_PROFILE_FRAME()
+#define TRIGGER_PROFILE_THREAD(name)
+#endif
+
+namespace trigger
+{
+	// Frame profiler.
+	//
+	// Every thread writes its scopes into a ring of its own: a plain store and
+	// a release of the count, so the threads never wait on each other or on
+	// the reader.  The reader copies the rings and drops whatever got
+	// overwritten while it copied.  The window shows the last frames as a
+	// timeline, a lane per thread and a row per nesting depth, and exports
+	// them as Chrome trace JSON for chrome://tracing or Perfetto.
+	//
+	// A thread that fills its ring faster than frames go by only keeps its
+	// latest scopes.  The rings of finished threads stay until exit.
+	class profiler
+	{
+	public:
+		struct event
+		{
+			const char *name;
+			int64_t begin_ns;
+			int64_t end_ns;
+			uint32_t depth;
+		};
+
+		static const size_t events_per_thread = 16384;
+		static const size_t max_frames = 128;
+
+		struct thread_buffer
+		{
+			std::string name;
+			uint32_t id = 0;
+			uint32_t depth = 0;
+			std::atomic<uint64_t> written{ 0 };
+			event events[events_per_thread];
+		};
+
+		static int64_t now()
+		{
+			return hires_clock::now_ns();
+		}
+
+		static thread_buffer &local()
+		{
+			thread_local thread_buffer *buffer = nullptr;
+			if (buffer == nullptr)
+			{
+				auto &s = state();
+				std::lock_guard<std::mutex> l(s.lock);
+				s.threads.push_back(std::unique_ptr<thread_buffer>(new thread_buffer()));
+				buffer = s.threads.back().get();
+				buffer->id = (uint32_t)s.threads.size();
+				buffer->name = "thread " + std::to_string(buffer->id);
+			}
+			return *buffer;
+		}
+
+		static void set_thread_name(const char *name)
+		{
+			auto &b = local();
+			std::lock_guard<std::mutex> l(state().lock);
+			b.name = name;
+		}
+
+		static void record(thread_buffer &b, const char *name, int64_t begin_ns, int64_t end_ns, uint32_t depth)
+		{
+			uint64_t n = b.written.load(std::memory_order_relaxed);
+			event &e = b.events[n & (events_per_thread - 1)];
+			e.name = name;
+			e.begin_ns = begin_ns;
+			e.end_ns = end_ns;
+			e.depth = depth;
+			b.written.store(n + 1, std::memory_order_release);
+		}
+
+		static void frame()
+		{
+			auto &s = state();
+			s.frames[s.frame_count % max_frames] = now();
+			s.frame_count++;
+		}
+
+		// Draws the profiler window, main thread.
+		static void draw(bool *window)
+		{
+			ImGui::SetNextWindowSize(ImVec2(900, 400), ImGuiCond_FirstUseEver);
+			if (!ImGui::Begin("Frame Profiler", window))
+			{
+				ImGui::End();
+				return;
+			}
+#if TRIGGER_PROFILE
+			auto &s = state();
+			auto &v = s.view;
+			ImGui::Checkbox("pause", &v.paused);
+			ImGui::SameLine();
+			ImGui::PushItemWidth(120);
+			ImGui::SliderInt("frames", &v.frames, 1, (int)max_frames - 1);
+			ImGui::SameLine();
+			ImGui::SliderFloat("zoom", &v.zoom, 1.0f, 64.0f, "%.1fx", 2.0f);
+			ImGui::PopItemWidth();
+			ImGui::SameLine();
+			if (ImGui::Button("Export"))
+			{
+				v.exported = export_chrome("trigger_trace.json") ? 1 : -1;
+			}
+			if (v.exported != 0)
+			{
+				ImGui::SameLine();
+				ImGui::Text("%s", v.exported > 0 ? "saved trigger_trace.json" : "can't save trigger_trace.json");
+			}
+
+			if (!v.paused)
+			{
+				capture(v.frames);
+			}
+			draw_timeline();
+#else
+			ImGui::Text("Profiling is compiled out, build with TRIGGER_PROFILE 1.");
+#endif
+			ImGui::End();
+		}
+
+		// The last captured frames as Chrome trace events, false when file
+		// can't be written.
+		static bool export_chrome(const char *file)
+		{
+			std::ofstream o(file);
+			if (!o.is_open())
+			{
+				return false;
+			}
+
+			auto &v = state().view;
+			o << "{\"traceEvents\":[\n";
+			bool first = true;
+			for (auto &lane : v.lanes)
+			{
+				o << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << lane.id
+					<< ",\"args\":{\"name\":\"" << lane.name << "\"}}";
+				first = false;
+				for (auto &e : lane.events)
+				{
+					o << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << lane.id
+						<< ",\"ts\":" << (e.begin_ns - v.begin_ns) / 1000.0 << ",\"dur\":" << (e.end_ns - e.begin_ns) / 1000.0 << "}";
+				}
+			}
+			for (size_t i = 0; i + 1 < v.frame_starts.size(); ++i)
+			{
+				o << (first ? "" : ",\n") << "{\"name\":\"frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":"
+					<< (v.frame_starts[i] - v.begin_ns) / 1000.0 << "}";
+				first = false;
+			}
+			o << "\n]}\n";
+			return o.good();
+		}
+
+	private:
+		struct lane
+		{
+			std::string name;
+			uint32_t id;
+			uint32_t depth;
+			std::vector<event> events;
+		};
+
+		struct view_state
+		{
+			bool paused = false;
+			int frames = 4;
+			float zoom = 1.0f;
+			int exported = 0;
+			int64_t begin_ns = 0;
+			int64_t end_ns = 0;
+			std::vector<int64_t> frame_starts;
+			std::vector<lane> lanes;
+		};
+
+		struct shared
+		{
+			std::mutex lock;
+			std::vector<std::unique_ptr<thread_buffer>> threads;
+			int64_t frames[max_frames] = {};
+			uint64_t frame_count = 0;
+			view_state view;
+		};
+
+		static shared &state()
+		{
+			static shared s;
+			return s;
+		}
+
+		// Copies the scopes of the last frames out of every ring.
+		static void capture(int frames)
+		{
+			auto &s = state();
+			auto &v = s.view;
+			v.frame_starts.clear();
+			uint64_t count = std::min<uint64_t>(s.frame_count, (uint64_t)frames + 1);
+			for (uint64_t i = s.frame_count - count; i < s.frame_count; ++i)
+			{
+				v.frame_starts.push_back(s.frames[i % max_frames]);
+			}
+			v.end_ns = now();
+			v.begin_ns = v.frame_starts.empty() ? v.end_ns : v.frame_starts.front();
+
+			std::lock_guard<std::mutex> l(s.lock);
+			v.lanes.resize(s.threads.size());
+			for (size_t t = 0; t < s.threads.size(); ++t)
+			{
+				auto &b = *s.threads[t];
+				auto &lane = v.lanes[t];
+				lane.name = b.name;
+				lane.id = b.id;
+				lane.depth = 0;
+				lane.events.clear();
+
+				uint64_t written = b.written.load(std::memory_order_acquire);
+				uint64_t from = written > events_per_thread ? written - events_per_thread : 0;
+				for (uint64_t i = from; i < written; ++i)
+				{
+					lane.events.push_back(b.events[i & (events_per_thread - 1)]);
+				}
+
+				// What the thread wrote meanwhile may have torn the oldest copies,
+				// and so may event after, which it can be storing before it counts it.
+				std::atomic_thread_fence(std::memory_order_acquire);
+				uint64_t after = b.written.load(std::memory_order_relaxed) + 1;
+				uint64_t overwritten = after > events_per_thread + from ? after - events_per_thread - from : 0;
+				size_t torn = (size_t)std::min<uint64_t>(overwritten, lane.events.size());
+				lane.events.erase(lane.events.begin(), lane.events.begin() + torn);
+
+				int64_t begin_ns = v.begin_ns;
+				lane.events.erase(std::remove_if(lane.events.begin(), lane.events.end(),
+					[begin_ns](const event &e) { return e.end_ns < begin_ns; }), lane.events.end());
+				for (auto &e : lane.events)
+				{
+					lane.depth = std::max<uint32_t>(lane.depth, e.depth + 1);
+				}
+			}
+		}
+
+		static void draw_timeline()
+		{
+			auto &v = state().view;
+			ImGui::BeginChild("timeline", ImVec2(0, 0), true, ImGuiWindowFlags_HorizontalScrollbar);
+			float width = ImGui::GetContentRegionAvail().x * v.zoom;
+			float row = ImGui::GetTextLineHeightWithSpacing();
+			double px_per_ns = width / (double)std::max<int64_t>(v.end_ns - v.begin_ns, 1);
+			ImVec2 origin = ImGui::GetCursorScreenPos();
+			ImDrawList *draw = ImGui::GetWindowDrawList();
+			ImVec2 clip_min = ImGui::GetWindowPos();
+			ImVec2 clip_max = ImVec2(clip_min.x + ImGui::GetWindowWidth(), clip_min.y + ImGui::GetWindowHeight());
+			ImVec2 mouse = ImGui::GetMousePos();
+			bool hovered = ImGui::IsWindowHovered();
+
+			float y = origin.y;
+			for (auto &lane : v.lanes)
+			{
+				float height = row * (lane.depth + 1);
+				draw->AddText(ImVec2(clip_min.x + 4, y), ImGui::GetColorU32(ImGuiCol_Text), lane.name.c_str());
+				y += row;
+				for (auto &e : lane.events)
+				{
+					float x0 = origin.x + (float)((e.begin_ns - v.begin_ns) * px_per_ns);
+					float x1 = std::max<float>(origin.x + (float)((e.end_ns - v.begin_ns) * px_per_ns), x0 + 1.0f);
+					if (x1 < clip_min.x || x0 > clip_max.x)
+					{
+						continue;
+					}
+					ImVec2 a(x0, y + e.depth * row);
+					ImVec2 b(x1, a.y + row - 1.0f);
+
+					// Same name, same colour.
+					unsigned int h = 2166136261u;
+					for (const char *c = e.name; *c != 0; ++c)
+					{
+						h = (h ^ (unsigned char)*c) * 16777619u;
+					}
+					draw->AddRectFilled(a, b, ImColor::HSV((h % 360) / 360.0f, 0.5f, 0.7f));
+					if (x1 - x0 > 8.0f)
+					{
+						ImVec4 clip(std::max<float>(x0, clip_min.x), a.y, std::min<float>(x1, clip_max.x), b.y);
+						draw->AddText(ImGui::GetFont(), ImGui::GetFontSize(), ImVec2(std::max<float>(x0, clip_min.x) + 2, a.y),
+							IM_COL32(255, 255, 255, 255), e.name, nullptr, 0.0f, &clip);
+					}
+					if (hovered && mouse.x >= a.x && mouse.x < b.x && mouse.y >= a.y && mouse.y < b.y)
+					{
+						ImGui::SetTooltip("%s\n%.3f ms", e.name, (e.end_ns - e.begin_ns) / 1000000.0);
+					}
+				}
+				y += height;
+			}
+
+			for (auto f : v.frame_starts)
+			{
+				float x = origin.x + (float)((f - v.begin_ns) * px_per_ns);
+				draw->AddLine(ImVec2(x, origin.y), ImVec2(x, y), IM_COL32(255, 255, 255, 96));
+			}
+
+			ImGui::Dummy(ImVec2(width, y - origin.y));
+			ImGui::EndChild();
+		}
+	};
+
+	class profile_scope
+	{
+	public:
+		explicit profile_scope(const char *name)
+			: buffer(profiler::local()), name(name), depth(buffer.depth++), begin_ns(profiler::now())
+		{
+		}
+
+		~profile_scope()
+		{
+			buffer.depth--;
+			profiler::record(buffer, name, begin_ns, profiler::now(), depth);
+		}
+
+		profile_scope(const profile_scope&) = delete;
+		profile_scope& operator=(const profile_scope&) = delete;
+
+	private:
+		profiler::thread_buffer &buffer;
+		const char *name;
+		uint32_t depth;
+		int64_t begin_ns;
+	};
+}
@@ -0,0 +1,230 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include "imgui.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace trigger
+{
+	// The engine's clocks.
+	//
+	// now_ns() is steady_clock, for timers and anything kept across frames.
+	// ticks() is the time stamp counter where there is one, a few cycles to
+	// read, for timing many short spans; seconds_per_tick() converts it,
+	// calibrated against steady_clock over the time since the first call, so
+	// it gets more exact the longer the program runs.
+	class hires_clock
+	{
+	public:
+		typedef std::chrono::steady_clock steady;
+
+		static inline int64_t now_ns()
+		{
+			return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(steady::now().time_since_epoch()).count();
+		}
+
+		static inline uint64_t ticks()
+		{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+			return __rdtsc();
+#else
+			return (uint64_t)now_ns();
+#endif
+		}
+
+		static double seconds_per_tick()
+		{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+			static const uint64_t first_ticks = ticks();
+			static const int64_t first_ns = now_ns();
+			// Below a ms of history the ratio is mostly noise, a 3GHz guess does better.
+			int64_t ns = now_ns() - first_ns;
+			uint64_t elapsed = ticks() - first_ticks;
+			if (ns < 1000000 || elapsed == 0)
+				return 1.0 / 3.0e9;
+			return ns * 1e-9 / elapsed;
+#else
+			return 1e-9;
+#endif
+		}
+
+		static inline double ms_per_tick()
+		{
+			return seconds_per_tick() * 1000.0;
+		}
+	};
+
+	// Histogram buckets for durations: the power of two of a value, then the
+	// three bits below its top one, so 8 buckets per power of two and a
+	// bucket's bound is within 1/8 of the values in it.  Values below 8 get
+	// a bucket each.  A value of n bits lands below bucket n * 8.
+	struct log_bucket
+	{
+		static inline int of(uint64_t v)
+		{
+			if (v < 8)
+				return (int)v;
+			int top = 63;
+			while ((v >> top) == 0)
+				top--;
+			return top * 8 + (int)((v >> (top - 3)) & 7);
+		}
+
+		// Just past the largest value of bucket b.
+		static inline double limit(int b)
+		{
+			if (b < 8)
+				return (double)b + 1.0;
+			return std::ldexp(8.0 + (b & 7) + 1, b / 8 - 3);
+		}
+	};
+
+	// Frame times of a loop over the last window frames: percentiles, hitches
+	// and the recent history for a plot.
+	//
+	// One thread adds, any thread reads.  Frames go into buckets of 8 per
+	// power of two of microseconds, so the percentiles are within 1/8 of
+	// their value.  A hitch is a frame over hitch_factor times the median.
+	class frame_histogram
+	{
+	public:
+		static const int window = 1024;
+		static const int bucket_count = 32 * 8;
+		static constexpr float hitch_factor = 2.0f;
+
+		struct summary
+		{
+			uint32_t frames;		// in the window
+			float last_ms;
+			float p50_ms;
+			float p95_ms;
+			float p99_ms;
+			float max_ms;
+			uint32_t hitches;		// in the window
+			uint64_t total_hitches;
+		};
+
+		frame_histogram()
+		{
+			reset();
+		}
+
+		frame_histogram(const frame_histogram&) = delete;
+		frame_histogram& operator=(const frame_histogram&) = delete;
+
+		void add(double seconds)
+		{
+			uint32_t us = (uint32_t)std::min<double>(std::max<double>(seconds * 1e6, 0.0), 4.0e9);
+			uint64_t n = count.load(std::memory_order_relaxed);
+			int slot = (int)(n % window);
+
+			// The frame leaving the window takes its bucket and hitch with it.
+			if (n >= window)
+			{
+				uint32_t old = recent[slot].load(std::memory_order_relaxed);
+				buckets[log_bucket::of(old)].fetch_sub(1, std::memory_order_relaxed);
+				if (old > hitch_us[slot])
+					window_hitches.fetch_sub(1, std::memory_order_relaxed);
+			}
+
+			// The median moves slowly, so it is looked up every 32 frames only.
+			if ((n & 31) == 0)
+				median_us = (uint32_t)(percentile(0.5) * 1000.0);
+			hitch_us[slot] = median_us != 0 ? (uint32_t)(median_us * hitch_factor) : UINT32_MAX;
+			if (us > hitch_us[slot])
+			{
+				window_hitches.fetch_add(1, std::memory_order_relaxed);
+				hitches.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			recent[slot].store(us, std::memory_order_relaxed);
+			buckets[log_bucket::of(us)].fetch_add(1, std::memory_order_relaxed);
+			count.store(n + 1, std::memory_order_release);
+		}
+
+		// Only while nothing adds.
+		void reset()
+		{
+			for (auto &b : buckets)
+				b.store(0, std::memory_order_relaxed);
+			for (auto &r : recent)
+				r.store(0, std::memory_order_relaxed);
+			for (auto &h : hitch_us)
+				h = UINT32_MAX;
+			count.store(0, std::memory_order_relaxed);
+			window_hitches.store(0, std::memory_order_relaxed);
+			hitches.store(0, std::memory_order_relaxed);
+			median_us = 0;
+		}
+
+		// In ms, the upper bound of the bucket holding it.
+		double percentile(double p) const
+		{
+			uint64_t frames = std::min<uint64_t>(count.load(std::memory_order_acquire), window);
+			if (frames == 0)
+				return 0.0;
+			uint64_t wanted = (uint64_t)(frames * p);
+			uint64_t seen = 0;
+			for (int b = 0; b < bucket_count; ++b)
+			{
+				seen += buckets[b].load(std::memory_order_relaxed);
+				if (seen > wanted)
+					return log_bucket::limit(b) / 1000.0;
+			}
+			return log_bucket::limit(bucket_count - 1) / 1000.0;
+		}
+
+		summary get() const
+		{
+			summary s = {};
+			uint64_t n = count.load(std::memory_order_acquire);
+			s.frames = (uint32_t)std::min<uint64_t>(n, window);
+			if (n == 0)
+				return s;
+			s.last_ms = recent[(n - 1) % window].load(std::memory_order_relaxed) / 1000.0f;
+			for (uint32_t i = 0; i < s.frames; ++i)
+				s.max_ms = std::max<float>(s.max_ms, recent[i].load(std::memory_order_relaxed) / 1000.0f);
+			// A bucket's bound may lie past the slowest frame in it.
+			s.p50_ms = std::min<float>((float)percentile(0.50), s.max_ms);
+			s.p95_ms = std::min<float>((float)percentile(0.95), s.max_ms);
+			s.p99_ms = std::min<float>((float)percentile(0.99), s.max_ms);
+			s.hitches = window_hitches.load(std::memory_order_relaxed);
+			s.total_hitches = hitches.load(std::memory_order_relaxed);
+			return s;
+		}
+
+		// The stats of the window and the last frames, oldest first.
+		void draw(const char *label) const
+		{
+			summary s = get();
+			ImGui::Text("%s: %.2f ms  p50 %.2f  p95 %.2f  p99 %.2f  max %.2f", label, s.last_ms, s.p50_ms, s.p95_ms, s.p99_ms, s.max_ms);
+			ImGui::Text("hitches (> %.0fx p50): %u of the last %u frames, %llu in all", hitch_factor, s.hitches, s.frames,
+				(unsigned long long)s.total_hitches);
+
+			static float plot[256];
+			uint64_t n = count.load(std::memory_order_acquire);
+			int shown = (int)std::min<uint64_t>(n, 256);
+			for (int i = 0; i < shown; ++i)
+				plot[i] = recent[(n - shown + i) % window].load(std::memory_order_relaxed) / 1000.0f;
+			ImGui::PushID(label);
+			ImGui::PlotLines("##frames", plot, shown, 0, nullptr, 0.0f, std::max<float>(s.p99_ms * 1.5f, 1.0f), ImVec2(0, 60));
+			ImGui::PopID();
+		}
+
+	private:
+		std::atomic<uint32_t> buckets[bucket_count];
+		std::atomic<uint32_t> recent[window];	// us
+		uint32_t hitch_us[window];				// the hitch line when each was added, writer only
+		std::atomic<uint64_t> count;
+		std::atomic<uint32_t> window_hitches;
+		std::atomic<uint64_t> hitches;
+		uint32_t median_us;
+	};
+}
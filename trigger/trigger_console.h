@@ -1,10 +1,15 @@
 #pragma once
 #include "imgui.h"
-#include <corecrt_malloc.h>
 #include <ctype.h>
 #include <vadefs.h>
 #include <stdio.h>
 #include <string>
+#include <deque>
+#include <unordered_set>
+#include "command_registry.h"
+#include "cvar.h"
+#include "log_ring.h"
+#include "log_file.h"
 #include "component_world.h"
 #include "actor.h"
 
@@ -19,33 +24,119 @@ namespace trigger
 		struct console
 		{
 			char                  InputBuf[256];
-			ImVector<char*>       Items;
+			log_ring              Ring;          // AddLog from any thread, drained by Draw.
+			log_file              Capture;       // Binary copy of what Draw drains, while open.
+			std::deque<log_record> Lines;        // The last MaxLines records, main thread only.
+			uint64_t              FirstLine;     // Number of Lines.front(), lines are numbered as they arrive.
+			ImGuiTextFilter       Filter;
+			std::deque<uint64_t>  Visible;       // Numbers of the lines in Lines passing Filter, in order.
 			bool                  ScrollToBottom;
-			ImVector<char*>       History;
-			int                   HistoryPos;    // -1: new line, 0..History.Size-1 browsing history.
-			ImVector<const char*> Commands;
+			std::deque<std::string> History;     // The last MaxHistory distinct lines, oldest first.
+			std::unordered_set<std::string> HistoryKeys; // Lowercase History, to find repeats without a scan.
+			int                   HistoryPos;    // -1: new line, 0..History.size()-1 browsing history.
+			command_registry      Commands;      // Subsystems add theirs, see RegisterCommands().
 			trigger::component_world *world;
 
-			console(trigger::component_world *world)
+			static const size_t RingSize = 1024;
+			static const size_t MaxLines = 65536;
+			static const size_t MaxHistory = 256;
+
+			console(trigger::component_world *world) : Ring(RingSize)
 			{
+				FirstLine = 0;
 				ClearLog();
 				memset(InputBuf, 0, sizeof(InputBuf));
 				HistoryPos = -1;
-				Commands.push_back("HELP");
-				Commands.push_back("HISTORY");
-				Commands.push_back("CLEAR");
-				Commands.push_back("show world");
-				Commands.push_back("CLASSIFY");  // "classify" is only here to provide an example of "C"+[tab] completing to "CL" and displaying matches.
+				this->world = world;
+				RegisterCommands();
 				AddLog("Trigger Engine Run!");
 				AddLog("Welcome!");
-				this->world = world;
 			}
 
 			~console()
 			{
 				ClearLog();
-				for (int i = 0; i < History.Size; i++)
-					free(History[i]);
+			}
+
+			// The console's own commands, the cvar ones and the world's.
+			void    RegisterCommands()
+			{
+				Commands.add("help", "lists the commands", {}, [this](const command_args&)
+				{
+					AddLog("Commands:");
+					for (auto c : Commands.list())
+						AddLog("- %-32s %s", command_registry::usage(*c).c_str(), c->help.c_str());
+				});
+				Commands.add("history", "shows the last n lines", { { "n", arg_int, true } }, [this](const command_args& a)
+				{
+					int count = a.get_int(0, 10);
+					int first = (int)History.size() - count;
+					for (int i = first > 0 ? first : 0; i < (int)History.size(); i++)
+						AddLog("%3d: %s\n", i, History[i].c_str());
+				});
+				Commands.add("clear", "clears the log", {}, [this](const command_args&)
+				{
+					ClearLog();
+				});
+				Commands.add("log", "logs text", { { "text", arg_text, false } }, [this](const command_args& a)
+				{
+					AddLog("[log] %s", a.get_string(0).c_str());
+				});
+				Commands.add("show world", "lists the actors and the update cost per component type", {}, [this](const command_args&)
+				{
+					ShowWorld();
+				});
+				Commands.add("set", "sets a cvar", { { "name", arg_string, false }, { "value", arg_text, false } }, [this](const command_args& a)
+				{
+					cvar* c = cvars::find(a.get_string(0));
+					if (c == nullptr)
+						AddLog("[error] no cvar %s", a.get_string(0).c_str());
+					else if (!c->parse(a.get_string(1)))
+						AddLog("[error] %s is not a value of %s", a.get_string(1).c_str(), c->name.c_str());
+					else if ((c->flags & cvar_restart) != 0)
+						AddLog("[log] %s = %s, from the next run", c->name.c_str(), c->to_string().c_str());
+					else
+						AddLog("[log] %s = %s", c->name.c_str(), c->to_string().c_str());
+				});
+				Commands.add("get", "shows a cvar", { { "name", arg_string, false } }, [this](const command_args& a)
+				{
+					cvar* c = cvars::find(a.get_string(0));
+					if (c == nullptr)
+						AddLog("[error] no cvar %s", a.get_string(0).c_str());
+					else
+						AddLog("[log] %s = %s  (%s)", c->name.c_str(), c->to_string().c_str(), c->help.c_str());
+				});
+				Commands.add("cvars", "lists the cvars starting with prefix", { { "prefix", arg_string, true } }, [this](const command_args& a)
+				{
+					const std::string& prefix = a.get_string(0);
+					for (auto c : cvars::list())
+						if (c->name.compare(0, prefix.size(), prefix) == 0)
+							AddLog("[log] %-28s %-12s %s", c->name.c_str(), c->to_string().c_str(), c->help.c_str());
+				});
+				Commands.add("cvars save", "writes the cvars to the config", {}, [this](const command_args&)
+				{
+					if (cvars::save(cvar_config))
+						AddLog("[log] cvars saved to %s", cvar_config);
+					else
+						AddLog("[error] can't save %s", cvar_config);
+				});
+				Commands.add("cvars load", "reads the cvars from the config", {}, [this](const command_args&)
+				{
+					std::string error;
+					if (cvars::load(cvar_config, error))
+						AddLog("[log] cvars loaded from %s", cvar_config);
+					else
+						AddLog("[error] can't load %s : %s", cvar_config, error.c_str());
+				});
+				Commands.add("cvars reset", "sets every cvar back to its default", {}, [](const command_args&)
+				{
+					for (auto c : cvars::list())
+						c->reset();
+				});
+				Commands.add("world reset stats", "restarts the update cost per component type", {}, [this](const command_args&)
+				{
+					world->reset_stats();
+				});
 			}
 
 			static int   Stricmp(const char* str1, const char* str2)
@@ -64,11 +155,6 @@ namespace trigger
 				} return d;
 			}
 
-			static char* Strdup(const char *str)
-			{
-				size_t len = strlen(str) + 1; void* buff = malloc(len); return (char*)memcpy(buff, (const void*)str, len);
-			}
-
 			static void  Strtrim(char* str)
 			{
 				char* str_end = str + strlen(str); while (str_end > str && str_end[-1] == ' ') str_end--; *str_end = 0;
@@ -76,26 +162,114 @@ namespace trigger
 
 			void    ClearLog()
 			{
-				for (int i = 0; i < Items.Size; i++)
-					free(Items[i]);
-				Items.clear();
+				FirstLine += Lines.size();
+				Lines.clear();
+				Visible.clear();
 				ScrollToBottom = true;
 			}
 
+			// Safe from any thread, never blocks.  Severity and tag come from the
+			// "[error]", "[lua-log]"... prefix of fmt.
 			void    AddLog(const char* fmt, ...) IM_FMTARGS(2)
 			{
-				// FIXME-OPT
-				char buf[1024];
 				va_list args;
 				va_start(args, fmt);
-				_vsnprintf_s(buf, IM_ARRAYSIZE(buf), fmt, args);
-				buf[IM_ARRAYSIZE(buf) - 1] = 0;
+				AddLogV(fmt, args);
 				va_end(args);
-				Items.push_back(Strdup(buf));
-				ScrollToBottom = true;
+			}
+
+			void    AddLogV(const char* fmt, va_list args)
+			{
+				log_severity severity = log_info;
+				const char* tag = "";
+				if (strncmp(fmt, "[error]", 7) == 0) severity = log_error;
+				else if (strncmp(fmt, "[lua-err]", 9) == 0) { severity = log_error; tag = "lua"; }
+				else if (strncmp(fmt, "[lua-log]", 9) == 0) tag = "lua";
+				else if (strncmp(fmt, "[log]", 5) == 0) tag = "log";
+				else if (strncmp(fmt, "# ", 2) == 0) tag = "cmd";
+				Ring.pushv(severity, tag, fmt, args);
+			}
+
+			// Deferred: fmt, a string literal, and the arguments are kept as they
+			// are and formatted by Draw, so a call costs a copy of the arguments.
+			template<typename... Args>
+			void    Log(log_severity severity, const char* tag, const char* fmt, const Args&... args)
+			{
+				Ring.push_deferred(severity, tag, fmt, args...);
+			}
+
+			// Moves what the ring holds to Lines.  Main thread.
+			void    Drain()
+			{
+				log_record r;
+				char formatted[sizeof(r.text)];
+				while (Ring.pop(r))
+				{
+					Capture.write(r);
+					format_record(r, formatted, sizeof(formatted));
+					r.format = nullptr;
+
+					// One row per text line, so that every row has the same height.
+					const char* text = formatted;
+					for (;;)
+					{
+						const char* eol = strchr(text, '\n');
+						size_t len = eol != nullptr ? (size_t)(eol - text) : strlen(text);
+						if (len > 0 || (eol == nullptr && text == formatted))
+						{
+							Lines.push_back(r);
+							memcpy(Lines.back().text, text, len);
+							Lines.back().text[len] = 0;
+							AddLine();
+						}
+						if (eol == nullptr)
+							break;
+						text = eol + 1;
+					}
+					ScrollToBottom = true;
+				}
+			}
+
+			void    AddLine()
+			{
+				if (Filter.PassFilter(Lines.back().text))
+					Visible.push_back(FirstLine + Lines.size() - 1);
+				if (Lines.size() > MaxLines)
+				{
+					Lines.pop_front();
+					FirstLine++;
+					while (!Visible.empty() && Visible.front() < FirstLine)
+						Visible.pop_front();
+				}
+			}
+
+			// After Filter changed.
+			void    RebuildVisible()
+			{
+				Visible.clear();
+				for (size_t i = 0; i < Lines.size(); i++)
+					if (Filter.PassFilter(Lines[i].text))
+						Visible.push_back(FirstLine + i);
+			}
+
+			void    DrawLine(const log_record& line)
+			{
+				ImVec4 col = ImGui::GetStyleColorVec4(ImGuiCol_Text);
+				if (line.severity == log_error) col = ImColor(1.0f, 0.4f, 0.4f, 1.0f);
+				else if (line.severity == log_warning) col = ImColor(1.0f, 0.8f, 0.3f, 1.0f);
+				else if (strcmp(line.tag, "cmd") == 0) col = ImColor(1.0f, 0.78f, 0.58f, 1.0f);
+				else if (strcmp(line.tag, "log") == 0) col = ImColor(0.6f, 0.4f, 0.4f, 1.0f);
+				else if (strcmp(line.tag, "lua") == 0) col = ImColor(0.4f, 0.3f, 0.5f, 1.0f);
+				ImGui::PushStyleColor(ImGuiCol_Text, col);
+				ImGui::TextUnformatted(line.text);
+				ImGui::PopStyleColor();
+				if (ImGui::IsItemHovered())
+					ImGui::SetTooltip("%.3f s, thread %08x", line.time_us / 1000000.0, line.thread);
 			}
 			void    Draw(const char* title, bool* p_open)
 			{
+				alloc_scope heap(tag_ui);
+				Drain();
 				if (!ImGui::Begin(title, p_open))
 				{
 					ImGui::End();
@@ -112,13 +286,7 @@ namespace trigger
 				}
 				if (ImGui::SmallButton("Show World"))
 				{
-					auto tmp = world->get_components<actor>();
-					AddLog("[log] Name\t\tEnable");
-					AddLog("[log] -------------------------");
-					for (auto t : tmp)
-					{
-						AddLog("[log] %s\t\t%d", t->name.c_str(), t->active);
-					}
+					ShowWorld();
 				} ImGui::SameLine();
 				if (ImGui::SmallButton("Add Dummy Error"))
 				{
@@ -129,14 +297,26 @@ namespace trigger
 					ClearLog();
 				} ImGui::SameLine();
 				bool copy_to_clipboard = ImGui::SmallButton("Copy"); ImGui::SameLine();
-				if (ImGui::SmallButton("Scroll to bottom")) ScrollToBottom = true;
+				if (ImGui::SmallButton("Scroll to bottom")) ScrollToBottom = true; ImGui::SameLine();
+				if (ImGui::SmallButton(Capture.is_open() ? "Stop Capture" : "Capture"))
+				{
+					if (Capture.is_open())
+						Capture.close();
+					else if (!Capture.open("trigger_log.tlog"))
+						AddLog("[error] can't open trigger_log.tlog");
+				}
+				if (uint64_t dropped = Ring.dropped_count())
+				{
+					ImGui::SameLine();
+					ImGui::TextColored(ImColor(1.0f, 0.4f, 0.4f, 1.0f), "%llu lines dropped", (unsigned long long)dropped);
+				}
 				//static float t = 0.0f; if (ImGui::GetTime() - t > 0.02f) { t = ImGui::GetTime(); AddLog("Spam %f", t); }
 
 				ImGui::Separator();
 
 				ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0, 0));
-				static ImGuiTextFilter filter;
-				filter.Draw("Filter (\"incl,-excl\") (\"error\")", 180);
+				if (Filter.Draw("Filter (\"incl,-excl\") (\"error\")", 180))
+					RebuildVisible();
 				ImGui::PopStyleVar();
 				ImGui::Separator();
 
@@ -148,38 +328,19 @@ namespace trigger
 					ImGui::EndPopup();
 				}
 
-				// Display every line as a separate entry so we can change their color or add custom widgets. If you only want raw text you can use ImGui::TextUnformatted(log.begin(), log.end());
-				// NB- if you have thousands of entries this approach may be too inefficient and may require user-side clipping to only process visible items.
-				// You can seek and display only the lines that are visible using the ImGuiListClipper helper, if your elements are evenly spaced and you have cheap random access to the elements.
-				// To use the clipper we could replace the 'for (int i = 0; i < Items.Size; i++)' loop with:
-				//     ImGuiListClipper clipper(Items.Size);
-				//     while (clipper.Step())
-				//         for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
-				// However, note that you can not use this code as is if a filter is active because it breaks the 'cheap random-access' property. We would need random-access on the post-filtered list.
-				// A typical application wanting coarse clipping and filtering may want to pre-compute an array of indices that passed the filtering test, recomputing this array when user changes the filter,
-				// and appending newly elements as they are inserted. This is left as a task to the user until we can manage to improve this example code!
-				// If your items are of variable size you may want to implement code similar to what ImGuiListClipper does. Or split your data into fixed height items to allow random-seeking into your list.
+				// Only the rows in view are submitted, out of the lines that passed the filter.
 				ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(4, 1)); // Tighten spacing
 				if (copy_to_clipboard)
+				{
 					ImGui::LogToClipboard();
-				ImVec4 col_default_text = ImGui::GetStyleColorVec4(ImGuiCol_Text);
-				for (int i = 0; i < Items.Size; i++)
-				{
-					const char* item = Items[i];
-					if (!filter.PassFilter(item))
-						continue;
-					ImVec4 col = col_default_text;
-					if (strstr(item, "[error]")) col = ImColor(1.0f, 0.4f, 0.4f, 1.0f);
-					else if (strncmp(item, "# ", 2) == 0) col = ImColor(1.0f, 0.78f, 0.58f, 1.0f);
-					else if (strstr(item, "[log]")) col = ImColor(0.6f, 0.4f, 0.4f, 1.0f);
-					else if (strstr(item, "[lua-log]")) col = ImColor(0.4f, 0.3f, 0.5f, 1.0f);
-					else if (strstr(item, "[lua-err]")) col = ImColor(1.0f, 0.4f, 0.4f, 1.0f);
-					ImGui::PushStyleColor(ImGuiCol_Text, col);
-					ImGui::TextUnformatted(item);
-					ImGui::PopStyleColor();
-				}
-				if (copy_to_clipboard)
+					for (auto n : Visible)
+						ImGui::LogText("%s\n", Lines[(size_t)(n - FirstLine)].text);
 					ImGui::LogFinish();
+				}
+				ImGuiListClipper clipper((int)Visible.size());
+				while (clipper.Step())
+					for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+						DrawLine(Lines[(size_t)(Visible[i] - FirstLine)]);
 				if (ScrollToBottom)
 					ImGui::SetScrollHereY(1.0f);
 				ScrollToBottom = false;
@@ -208,56 +369,67 @@ namespace trigger
 				ImGui::End();
 			}
 
-			void    ExecCommand(const char* command_line)
+			// Actors, then the update cost of every component type.
+			void    ShowWorld()
 			{
-				AddLog("# %s\n", command_line);
-
-				// Insert into history. First find match and delete it so it can be pushed to the back. This isn't trying to be smart or optimal.
-				HistoryPos = -1;
-				for (int i = History.Size - 1; i >= 0; i--)
-					if (Stricmp(History[i], command_line) == 0)
-					{
-						free(History[i]);
-						History.erase(History.begin() + i);
-						break;
-					}
-				History.push_back(Strdup(command_line));
-				auto a = std::string(command_line);
-				// Process command
-				if (Stricmp(command_line, "CLEAR") == 0)
+				auto tmp = world->get_components<actor>();
+				AddLog("[log] Name\t\tEnable");
+				AddLog("[log] -------------------------");
+				for (auto t : tmp)
 				{
-					ClearLog();
+					AddLog("[log] %s\t\t%d", t->name.c_str(), t->active);
 				}
-				else if (Stricmp(command_line, "HELP") == 0)
-				{
-					AddLog("Commands:");
-					for (int i = 0; i < Commands.Size; i++)
-						AddLog("- %s", Commands[i]);
-				}
-				else if (Stricmp(command_line, "HISTORY") == 0)
+
+				AddLog("[log] %-32s %6s %10s %10s %9s %9s %9s", "Type", "Count", "Calls", "Total ms", "Min ms", "Max ms", "P99 ms");
+				for (auto& r : world->get_stats())
 				{
-					int first = History.Size - 10;
-					for (int i = first > 0 ? first : 0; i < History.Size; i++)
-						AddLog("%3d: %s\n", i, History[i]);
+					AddLog("[log] %-32s %6u %10llu %10.3f %9.4f %9.4f %9.4f", r.name.c_str(), r.instances,
+						(unsigned long long)r.calls, r.total_ms, r.min_ms, r.max_ms, r.p99_ms);
 				}
-				else if (a.find("log", 0) != std::string::npos)
+			}
+
+			void    ExecCommand(const char* command_line)
+			{
+				AddLog("# %s\n", command_line);
+
+				// Insert into history. A repeated line moves to the back, the key set
+				// says whether it is there at all.
+				HistoryPos = -1;
+				std::string key = command_line;
+				for (auto& c : key)
+					c = (char)tolower((unsigned char)c);
+				if (!HistoryKeys.insert(key).second)
 				{
-					AddLog("[log] %s", command_line);
+					for (size_t i = History.size(); i-- > 0;)
+						if (Stricmp(History[i].c_str(), command_line) == 0)
+						{
+							History.erase(History.begin() + i);
+							break;
+						}
 				}
-				else if (Stricmp(command_line, "show world") == 0)
+				else if (History.size() >= MaxHistory)
 				{
-					auto tmp = world->get_components<actor>();
-					AddLog("[log] Name\t\tEnable");
-					AddLog("[log] -------------------------");
-					for (auto t : tmp)
-					{
-						AddLog("[log] %s\t\t%d", t->name.c_str(), t->active);
-					}
+					std::string oldest = History.front();
+					for (auto& c : oldest)
+						c = (char)tolower((unsigned char)c);
+					HistoryKeys.erase(oldest);
+					History.pop_front();
 				}
-				else
+				History.push_back(command_line);
+
+				Exec(command_line);
+			}
+
+			// Runs a command without echoing or recording it, for scripts.
+			bool    Exec(const char* command_line)
+			{
+				std::string error;
+				if (Commands.exec(command_line, error) != command_registry::exec_ok)
 				{
-					AddLog("Unknown command: '%s'\n", command_line);
+					AddLog("[error] %s", error.c_str());
+					return false;
 				}
+				return true;
 			}
 
 			static int TextEditCallbackStub(ImGuiInputTextCallbackData* data) // In C++11 you are better off using lambdas for this sort of forwarding callbacks
@@ -274,63 +446,41 @@ namespace trigger
 				{
 					// Example of TEXT COMPLETION
 
-					// Locate beginning of current word
+					// Command names may hold spaces, so the whole line up to the cursor is the prefix.
 					const char* word_end = data->Buf + data->CursorPos;
-					const char* word_start = word_end;
-					while (word_start > data->Buf)
-					{
-						const char c = word_start[-1];
-						if (c == ' ' || c == '\t' || c == ',' || c == ';')
-							break;
-						word_start--;
-					}
+					const char* word_start = data->Buf;
+					while (word_start < word_end && *word_start == ' ')
+						word_start++;
 
-					// Build a list of candidates
-					ImVector<const char*> candidates;
-					for (int i = 0; i < Commands.Size; i++)
-						if (Strnicmp(Commands[i], word_start, (int)(word_end - word_start)) == 0)
-							candidates.push_back(Commands[i]);
+					std::vector<const command_registry::command*> candidates;
+					size_t match_len = Commands.complete(word_start, word_end - word_start, candidates);
 
-					if (candidates.Size == 0)
+					if (candidates.size() == 0)
 					{
 						// No match
 						AddLog("No match for \"%.*s\"!\n", (int)(word_end - word_start), word_start);
 					}
-					else if (candidates.Size == 1)
+					else if (candidates.size() == 1)
 					{
 						// Single match. Delete the beginning of the word and replace it entirely so we've got nice casing
 						data->DeleteChars((int)(word_start - data->Buf), (int)(word_end - word_start));
-						data->InsertChars(data->CursorPos, candidates[0]);
+						data->InsertChars(data->CursorPos, candidates[0]->name.c_str());
 						data->InsertChars(data->CursorPos, " ");
 					}
 					else
 					{
-						// Multiple matches. Complete as much as we can, so inputing "C" will complete to "CL" and display "CLEAR" and "CLASSIFY"
-						int match_len = (int)(word_end - word_start);
-						for (;;)
-						{
-							int c = 0;
-							bool all_candidates_matches = true;
-							for (int i = 0; i < candidates.Size && all_candidates_matches; i++)
-								if (i == 0)
-									c = toupper(candidates[i][match_len]);
-								else if (c == 0 || c != toupper(candidates[i][match_len]))
-									all_candidates_matches = false;
-							if (!all_candidates_matches)
-								break;
-							match_len++;
-						}
-
+						// Multiple matches. The trie knows how far they all agree, so inputing "s" completes to "show " when all start so
 						if (match_len > 0)
 						{
+							const char* name = candidates[0]->name.c_str();
 							data->DeleteChars((int)(word_start - data->Buf), (int)(word_end - word_start));
-							data->InsertChars(data->CursorPos, candidates[0], candidates[0] + match_len);
+							data->InsertChars(data->CursorPos, name, name + match_len);
 						}
 
 						// List matches
 						AddLog("Possible matches:\n");
-						for (int i = 0; i < candidates.Size; i++)
-							AddLog("- %s\n", candidates[i]);
+						for (auto c : candidates)
+							AddLog("- %s\n", command_registry::usage(*c).c_str());
 					}
 
 					break;
@@ -342,21 +492,21 @@ namespace trigger
 					if (data->EventKey == ImGuiKey_UpArrow)
 					{
 						if (HistoryPos == -1)
-							HistoryPos = History.Size - 1;
+							HistoryPos = (int)History.size() - 1;
 						else if (HistoryPos > 0)
 							HistoryPos--;
 					}
 					else if (data->EventKey == ImGuiKey_DownArrow)
 					{
 						if (HistoryPos != -1)
-							if (++HistoryPos >= History.Size)
+							if (++HistoryPos >= (int)History.size())
 								HistoryPos = -1;
 					}
 
 					// A better implementation would preserve the data on the current input line along with cursor position.
 					if (prev_history_pos != HistoryPos)
 					{
-						const char* history_str = (HistoryPos >= 0) ? History[HistoryPos] : "";
+						const char* history_str = (HistoryPos >= 0) ? History[HistoryPos].c_str() : "";
 						data->DeleteChars(0, data->BufTextLen);
 						data->InsertChars(0, history_str);
 					}
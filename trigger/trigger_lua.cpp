@@ -2,11 +2,41 @@
 
 bool trigger::tlua::is_inited = false;
 lua_State *trigger::tlua::L = nullptr;
+trigger::lua_allocator trigger::tlua::memory;
+size_t trigger::tlua::script_budget = 16 * 1024 * 1024;
+float trigger::tlua::gc_budget_ms = 1.0f;
+int trigger::tlua::gc_pause = 100;
+bool trigger::tlua::gc_running = false;
+int trigger::tlua::gc_threshold_kb = 256;
+float trigger::tlua::gc_last_ms = 0.0f;
+float trigger::tlua::gc_avg_ms = 0.0f;
+float trigger::tlua::gc_max_ms = 0.0f;
+unsigned int trigger::tlua::gc_cycles = 0;
+bool trigger::tlua::profiling = false;
+int trigger::tlua::profile_interval = 1000;
+uint64_t trigger::tlua::profile_samples = 0;
+std::unordered_map<std::string, trigger::tlua::profile_entry> trigger::tlua::profile_functions;
+std::unordered_map<std::string, uint64_t> trigger::tlua::profile_files;
+std::unordered_map<std::string, uint64_t> trigger::tlua::profile_stacks;
+ImVec2 trigger::tlua::editor_pos;
+ImVec2 trigger::tlua::editor_size;
+bool trigger::tlua::show_profiler = false;
+std::list<trigger::tlua::script> trigger::tlua::scripts;
+std::vector<trigger::tlua::actor_slot> trigger::tlua::actor_slots;
+std::vector<unsigned int> trigger::tlua::free_actor_slots;
+std::unordered_map<trigger::actor*, unsigned int> trigger::tlua::actor_slot_of;
+std::vector<trigger::tlua::command> trigger::tlua::commands;
+std::thread trigger::tlua::script_thread;
+std::mutex trigger::tlua::script_mutex;
+std::condition_variable trigger::tlua::script_wake;
+std::condition_variable trigger::tlua::script_done;
+bool trigger::tlua::script_pending = false;
+bool trigger::tlua::script_quit = false;
+float trigger::tlua::script_delta = 0.0f;
 trigger::ui::console *trigger::tlua::cmd = nullptr;
 trigger::component_world *trigger::tlua::world = nullptr;
 TextEditor trigger::tlua::edit;
 TextEditor::LanguageDefinition trigger::tlua::lang = TextEditor::LanguageDefinition::Lua();
 bool trigger::tlua::lua_editor_init = false;
 std::string trigger::tlua::path = "";
-bool trigger::tlua::close = false;
 trigger::actor *trigger::tlua::target;
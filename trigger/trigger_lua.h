@@ -5,8 +5,20 @@
 #include <string>
 #include <stdio.h>
 #include <fstream>
+#include <list>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdarg>
 #include "trigger_console.h"
 #include "TextEditor.h"
+#include "lua_allocator.h"
+#include "profiler.h"
+#include "trigger_clock.h"
 #include "d3dApp.h"
 
 extern "C"
@@ -16,6 +28,9 @@ extern "C"
 #include <lauxlib.h>
 }
 
+// Metatable of the actor handles given to lua.
+#define T_ACTOR_META "trigger.actor"
+
 namespace trigger
 {
 	class tlua
@@ -30,18 +45,727 @@ namespace trigger
 			ScriptError,
 		};
 
+		// One lua file running for one actor.  Its chunk runs with its own
+		// environment table, so the globals it defines (init, update, destroy...)
+		// belong to that actor only.  Reads that miss fall back to _G.
+		// The callbacks are registry refs, resolved once when the file is loaded.
+		struct script
+		{
+			trigger::actor *owner = nullptr;
+			std::string file;
+			int env = LUA_NOREF;
+			int init = LUA_NOREF;
+			int update = LUA_NOREF;
+			int destroy = LUA_NOREF;
+
+			// Cost of update(delta) in ms: last frame, moving average and worst.
+			float last_ms = 0.0f;
+			float avg_ms = 0.0f;
+			float max_ms = 0.0f;
+
+			// Errors are logged at most once per error_interval for each script,
+			// the ones in between are only counted.
+			unsigned int errors = 0;
+			unsigned int suppressed = 0;
+			int64_t last_report_ns = 0;
+
+			// Modification time of file when it was last loaded.
+			time_t modified = 0;
+
+			// Owner id in tlua::memory, and bytes allocated per second.
+			unsigned int memory = 0;
+			uint64_t last_allocated = 0;
+			float alloc_rate = 0.0f;
+		};
+
+		static constexpr float error_interval = 1.0f;
+
+		// Actors are given to lua as full userdata holding a slot index and the
+		// generation of that slot.  Deleting an actor bumps the generation, so a
+		// handle a script kept goes stale instead of dangling, and every call on
+		// a handle is O(1).
+		struct actor_handle
+		{
+			unsigned int index;
+			unsigned int generation;
+		};
+
+		struct actor_slot
+		{
+			trigger::actor *actor = nullptr;
+			unsigned int generation = 0;
+		};
+
+		static std::vector<actor_slot> actor_slots;
+		static std::vector<unsigned int> free_actor_slots;
+		static std::unordered_map<trigger::actor*, unsigned int> actor_slot_of;
+
+		// The scripts run on their own thread, one tick per frame between kick()
+		// and sync().  They read the world as it is but never write to it: every
+		// change is recorded here and applied by sync() on the main thread, when
+		// no script runs.  Everything else of tlua is touched by the main thread
+		// only while the script thread is idle.
+		enum command_type
+		{
+			cmd_set_position,
+			cmd_set_rotation,
+			cmd_set_scale,
+			cmd_move,
+			cmd_rotate,
+			cmd_rename,
+			cmd_spawn,
+			cmd_exec,		// a console command line, in name
+		};
+
+		struct command
+		{
+			command_type type;
+			actor_handle actor;
+			float x, y, z;
+			std::string name;
+		};
+
+		static std::vector<command> commands;
+
+		static std::thread script_thread;
+		static std::mutex script_mutex;
+		static std::condition_variable script_wake;
+		static std::condition_variable script_done;
+		static bool script_pending;
+		static bool script_quit;
+		static float script_delta;
+
 		static bool is_inited;
 		static lua_State *L;
+		static lua_allocator memory;
+		static size_t script_budget;
+
+		// The collector only runs from gc_step(), at most gc_budget_ms a frame.
+		// A new cycle starts once the heap has grown gc_pause percent over its
+		// size after the last one, like lua's own pause.
+		static float gc_budget_ms;
+		static int gc_pause;
+		static bool gc_running;
+		static int gc_threshold_kb;
+		static float gc_last_ms;
+		static float gc_avg_ms;
+		static float gc_max_ms;
+		static unsigned int gc_cycles;
+
+		// Sampling profiler: while profiling, a count hook takes a sample every
+		// profile_interval VM instructions and charges it to the functions on
+		// the lua stack.  Without profiling there is no hook at all.
+		struct profile_entry
+		{
+			uint64_t self = 0;		// samples with the function on top
+			uint64_t total = 0;		// samples with the function anywhere on the stack
+		};
+
+		static const int profile_max_depth = 64;
+		static bool profiling;
+		static int profile_interval;
+		static uint64_t profile_samples;
+		static std::unordered_map<std::string, profile_entry> profile_functions;
+		static std::unordered_map<std::string, uint64_t> profile_files;
+		static std::unordered_map<std::string, uint64_t> profile_stacks;	// folded, root first
+		static ImVec2 editor_pos;
+		static ImVec2 editor_size;
+
+		static std::list<script> scripts;
 		static trigger::component_world *world;
 		static trigger::actor *target;
 		static TextEditor edit;
 		static TextEditor::LanguageDefinition lang;
 		static bool lua_editor_init;
 		static std::string path;
-		static bool close;
+
+		// Console output, from either thread.
+		static void post_log(const char *fmt, ...)
+		{
+			va_list args;
+			va_start(args, fmt);
+			tlua::cmd->AddLogV(fmt, args);
+			va_end(args);
+		}
+
+		// Registry ref of env[name] when it is a function, LUA_NOREF otherwise.
+		static int ref_func(int env, const char *name)
+		{
+			lua_rawgeti(L, LUA_REGISTRYINDEX, env);
+			lua_getfield(L, -1, name);
+			int ref = LUA_NOREF;
+			if (lua_isfunction(L, -1))
+			{
+				ref = luaL_ref(L, LUA_REGISTRYINDEX);
+			}
+			else
+			{
+				lua_pop(L, 1);
+			}
+			lua_pop(L, 1);
+			return ref;
+		}
+
+		// Message handler of every pcall, adds the traceback to the error.
+		static int traceback(lua_State *L)
+		{
+			const char *msg = lua_tostring(L, 1);
+			if (msg == nullptr)
+			{
+				msg = luaL_tolstring(L, 1, nullptr);
+			}
+			luaL_traceback(L, L, msg, 1);
+			return 1;
+		}
+
+		static void report(script &s, const char *msg)
+		{
+			int64_t now = hires_clock::now_ns();
+			s.errors++;
+			if (s.errors > 1 && (now - s.last_report_ns) * 1e-9f < error_interval)
+			{
+				s.suppressed++;
+				return;
+			}
+
+			if (s.suppressed != 0)
+			{
+				tlua::cmd->Log(log_error, "lua", "[lua-err] %s : %u more errors", s.file, s.suppressed);
+			}
+			tlua::cmd->Log(log_error, "lua", "[lua-err] %s : %s", s.file, msg);
+			s.suppressed = 0;
+			s.last_report_ns = now;
+		}
+
+		// Compiled chunks are cached next to their script as <file>c, behind this
+		// header.  The cache is used while both the hash of the source and the
+		// Lua version match.
+		struct chunk_header
+		{
+			char magic[4];
+			uint32_t version;
+			uint64_t hash;
+		};
+
+		// FNV-1a.
+		static uint64_t hash_source(const std::string &source)
+		{
+			uint64_t h = 14695981039346656037ull;
+			for (unsigned char c : source)
+			{
+				h = (h ^ c) * 1099511628211ull;
+			}
+			return h;
+		}
+
+		static int write_chunk(lua_State *L, const void *p, size_t size, void *ud)
+		{
+			((std::string*)ud)->append((const char*)p, size);
+			return 0;
+		}
+
+		// luaL_loadfile through the bytecode cache.  Pushes the chunk, or the
+		// error message when it fails.
+		static int load_chunk(const std::string &file)
+		{
+			std::ifstream i(file, std::ios::binary);
+			if (!i.is_open())
+			{
+				lua_pushfstring(L, "cannot open %s", file.c_str());
+				return LUA_ERRFILE;
+			}
+			std::string source((std::istreambuf_iterator<char>(i)), std::istreambuf_iterator<char>());
+			std::string name = "@" + file;
+			chunk_header header = { { 'T', 'L', 'U', 'C' }, LUA_VERSION_NUM, hash_source(source) };
+
+			std::ifstream c(file + "c", std::ios::binary);
+			chunk_header cached;
+			if (c.read((char*)&cached, sizeof(cached)) && memcmp(&cached, &header, sizeof(header)) == 0)
+			{
+				std::string code((std::istreambuf_iterator<char>(c)), std::istreambuf_iterator<char>());
+				if (luaL_loadbufferx(L, code.data(), code.size(), name.c_str(), "b") == LUA_OK)
+				{
+					return LUA_OK;
+				}
+				// Written by a build that does not match after all, compile again.
+				lua_pop(L, 1);
+			}
+			c.close();
+
+			int status = luaL_loadbuffer(L, source.data(), source.size(), name.c_str());
+			if (status != LUA_OK)
+			{
+				return status;
+			}
+
+			// Keeping the debug info, the tracebacks need it.
+			std::string code;
+			lua_dump(L, write_chunk, &code, 0);
+			ofstream o(file + "c", std::ios::binary | std::ios::trunc);
+			if (o.is_open())
+			{
+				o.write((const char*)&header, sizeof(header));
+				o.write(code.data(), code.size());
+			}
+			return LUA_OK;
+		}
+
+		// Calls a callback ref without arguments.
+		static bool call(script &s, int ref)
+		{
+			if (ref == LUA_NOREF)
+			{
+				return true;
+			}
+
+			unsigned int previous = memory.current;
+			memory.current = s.memory;
+			lua_pushcfunction(L, traceback);
+			lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+			bool ok = lua_pcall(L, 0, 0, -2) == LUA_OK;
+			if (!ok)
+			{
+				report(s, lua_tostring(L, -1));
+				lua_pop(L, 1);
+			}
+			lua_pop(L, 1);
+			memory.current = previous;
+			return ok;
+		}
+
+		static void unref(script &s)
+		{
+			luaL_unref(L, LUA_REGISTRYINDEX, s.init);
+			luaL_unref(L, LUA_REGISTRYINDEX, s.update);
+			luaL_unref(L, LUA_REGISTRYINDEX, s.destroy);
+			luaL_unref(L, LUA_REGISTRYINDEX, s.env);
+			s.init = s.update = s.destroy = s.env = LUA_NOREF;
+		}
+
+		// Actor of the handle at idx, nullptr when stale.  Names are still
+		// taken for the scripts written before handles, first match wins.
+		static trigger::actor *to_actor(lua_State *L, int idx)
+		{
+			auto h = (actor_handle*)luaL_testudata(L, idx, T_ACTOR_META);
+			if (h != nullptr)
+			{
+				if (h->index < actor_slots.size() && actor_slots[h->index].generation == h->generation)
+				{
+					return actor_slots[h->index].actor;
+				}
+				return nullptr;
+			}
+
+			if (lua_type(L, idx) == LUA_TSTRING)
+			{
+				const char *name = lua_tostring(L, idx);
+				for (auto a : tlua::world->get_components<trigger::actor>())
+				{
+					if (a->name.compare(name) == 0)
+					{
+						return a;
+					}
+				}
+			}
+			return nullptr;
+		}
+
+		static trigger::actor *check_actor(lua_State *L, int idx)
+		{
+			auto a = to_actor(L, idx);
+			if (a == nullptr)
+			{
+				luaL_argerror(L, idx, "no such actor, or it was deleted");
+			}
+			return a;
+		}
+
+		// Handle of the actor at idx, the way to_actor() finds it.
+		static bool to_handle(lua_State *L, int idx, actor_handle &h)
+		{
+			auto a = to_actor(L, idx);
+			if (a == nullptr)
+			{
+				return false;
+			}
+			h.index = slot_of(a);
+			h.generation = actor_slots[h.index].generation;
+			return true;
+		}
+
+		static actor_handle check_handle(lua_State *L, int idx)
+		{
+			actor_handle h;
+			if (!to_handle(L, idx, h))
+			{
+				luaL_argerror(L, idx, "no such actor, or it was deleted");
+			}
+			return h;
+		}
+
+		static void record(command_type type, actor_handle h, float x, float y, float z)
+		{
+			command c;
+			c.type = type;
+			c.actor = h;
+			c.x = x;
+			c.y = y;
+			c.z = z;
+			commands.push_back(std::move(c));
+		}
+
+		static void check_vec(lua_State *L, int idx, trigger::vec &v)
+		{
+			luaL_checktype(L, idx, LUA_TTABLE);
+			lua_getfield(L, idx, "x");
+			lua_getfield(L, idx, "y");
+			lua_getfield(L, idx, "z");
+			v.x = (float)lua_tonumber(L, -3);
+			v.y = (float)lua_tonumber(L, -2);
+			v.z = (float)lua_tonumber(L, -1);
+			lua_pop(L, 3);
+		}
+
+		static void push_vec(lua_State *L, const trigger::vec &v)
+		{
+			lua_createtable(L, 0, 3);
+			lua_pushnumber(L, v.x);
+			lua_setfield(L, -2, "x");
+			lua_pushnumber(L, v.y);
+			lua_setfield(L, -2, "y");
+			lua_pushnumber(L, v.z);
+			lua_setfield(L, -2, "z");
+		}
+
+		// Drops the slot of a deleted actor.  Its handles go stale.
+		static void release_actor(trigger::actor *a)
+		{
+			auto found = actor_slot_of.find(a);
+			if (found != actor_slot_of.end())
+			{
+				auto &slot = actor_slots[found->second];
+				slot.actor = nullptr;
+				slot.generation++;
+				free_actor_slots.push_back(found->second);
+				actor_slot_of.erase(found);
+			}
+		}
+
+		// actor.name, actor.position, actor.rotation, actor.scale, then the methods.
+		static int actor_index(lua_State *L)
+		{
+			const char *key = luaL_checkstring(L, 2);
+			if (strcmp(key, "name") == 0 || strcmp(key, "position") == 0 ||
+				strcmp(key, "rotation") == 0 || strcmp(key, "scale") == 0)
+			{
+				auto a = check_actor(L, 1);
+				switch (key[0])
+				{
+				case 'n': lua_pushstring(L, a->name.c_str()); break;
+				case 'p': push_vec(L, a->s_transform.position); break;
+				case 'r': push_vec(L, a->s_transform.rotation); break;
+				default: push_vec(L, a->s_transform.scale); break;
+				}
+				return 1;
+			}
+
+			lua_getfield(L, lua_upvalueindex(1), key);
+			return 1;
+		}
+
+		static int actor_newindex(lua_State *L)
+		{
+			auto h = check_handle(L, 1);
+			const char *key = luaL_checkstring(L, 2);
+			trigger::vec v;
+			if (strcmp(key, "position") == 0)
+			{
+				check_vec(L, 3, v);
+				record(cmd_set_position, h, v.x, v.y, v.z);
+			}
+			else if (strcmp(key, "rotation") == 0)
+			{
+				check_vec(L, 3, v);
+				record(cmd_set_rotation, h, v.x, v.y, v.z);
+			}
+			else if (strcmp(key, "scale") == 0)
+			{
+				check_vec(L, 3, v);
+				record(cmd_set_scale, h, v.x, v.y, v.z);
+			}
+			else if (strcmp(key, "name") == 0)
+			{
+				const char *name = luaL_checkstring(L, 3);
+				record(cmd_rename, h, 0, 0, 0);
+				commands.back().name = name;
+			}
+			else
+			{
+				luaL_error(L, "actor has no field '%s'", key);
+			}
+			return 0;
+		}
+
+		static int actor_eq(lua_State *L)
+		{
+			auto a = (actor_handle*)luaL_checkudata(L, 1, T_ACTOR_META);
+			auto b = (actor_handle*)luaL_checkudata(L, 2, T_ACTOR_META);
+			lua_pushboolean(L, a->index == b->index && a->generation == b->generation);
+			return 1;
+		}
+
+		static int actor_tostring(lua_State *L)
+		{
+			auto a = to_actor(L, 1);
+			lua_pushfstring(L, "actor(%s)", a != nullptr ? a->name.c_str() : "deleted");
+			return 1;
+		}
+
+		static int actor_valid(lua_State *L)
+		{
+			lua_pushboolean(L, to_actor(L, 1) != nullptr);
+			return 1;
+		}
+
+		static void register_actor_meta()
+		{
+			luaL_newmetatable(L, T_ACTOR_META);
+
+			const luaL_Reg methods[] =
+			{
+				{ "move", t_transform<cmd_move> },
+				{ "rotate", t_transform<cmd_rotate> },
+				{ "set_position", t_transform<cmd_set_position> },
+				{ "set_rotation", t_transform<cmd_set_rotation> },
+				{ "set_scale", t_transform<cmd_set_scale> },
+				{ "valid", actor_valid },
+				{ nullptr, nullptr },
+			};
+			luaL_newlib(L, methods);
+			lua_pushcclosure(L, actor_index, 1);
+			lua_setfield(L, -2, "__index");
+
+			lua_pushcfunction(L, actor_newindex);
+			lua_setfield(L, -2, "__newindex");
+			lua_pushcfunction(L, actor_eq);
+			lua_setfield(L, -2, "__eq");
+			lua_pushcfunction(L, actor_tostring);
+			lua_setfield(L, -2, "__tostring");
+			lua_pop(L, 1);
+		}
+
+		// "name (file:line)" of the function at level, false past the stack.
+		static bool profile_frame(lua_State *L, int level, std::string &key, std::string &file)
+		{
+			lua_Debug d;
+			if (!lua_getstack(L, level, &d))
+			{
+				return false;
+			}
+			lua_getinfo(L, "Sn", &d);
+			file = d.short_src;
+			char buf[LUA_IDSIZE + 128];
+			if (*d.what == 'm')
+			{
+				snprintf(buf, sizeof(buf), "main chunk (%s)", d.short_src);
+			}
+			else
+			{
+				snprintf(buf, sizeof(buf), "%s (%s:%d)", d.name != nullptr ? d.name : "?", d.short_src, d.linedefined);
+			}
+			key = buf;
+			return true;
+		}
+
+		static void profile_hook(lua_State *L, lua_Debug *ar)
+		{
+			std::string keys[profile_max_depth];
+			std::string file;
+			int depth = 0;
+			while (depth < profile_max_depth && profile_frame(L, depth, keys[depth], file))
+			{
+				depth++;
+			}
+			if (depth == 0)
+			{
+				return;
+			}
+			profile_samples++;
+
+			// file is the one of the outermost frame: the script that was called.
+			profile_files[file]++;
+
+			std::string folded;
+			for (int i = depth - 1; i >= 0; --i)
+			{
+				// Recursion counts once towards total.
+				bool seen = false;
+				for (int j = depth - 1; j > i; --j)
+				{
+					if (keys[j] == keys[i])
+					{
+						seen = true;
+						break;
+					}
+				}
+				auto &e = profile_functions[keys[i]];
+				if (!seen)
+				{
+					e.total++;
+				}
+				if (i == 0)
+				{
+					e.self++;
+				}
+
+				folded += keys[i];
+				if (i > 0)
+				{
+					folded += ';';
+				}
+			}
+			profile_stacks[folded]++;
+		}
 
 	public:
 		static trigger::ui::console *cmd;
+		static bool show_profiler;
+
+		// Slot of a, given the first time it is asked for.
+		static unsigned int slot_of(trigger::actor *a)
+		{
+			auto found = actor_slot_of.find(a);
+			if (found != actor_slot_of.end())
+			{
+				return found->second;
+			}
+
+			unsigned int index;
+			if (!free_actor_slots.empty())
+			{
+				index = free_actor_slots.back();
+				free_actor_slots.pop_back();
+			}
+			else
+			{
+				index = (unsigned int)actor_slots.size();
+				actor_slots.push_back(actor_slot());
+			}
+			actor_slots[index].actor = a;
+			actor_slot_of[a] = index;
+			return index;
+		}
+
+		// Pushes the handle of a.
+		static void push_actor(lua_State *L, trigger::actor *a)
+		{
+			unsigned int index = slot_of(a);
+			auto h = (actor_handle*)lua_newuserdata(L, sizeof(actor_handle));
+			h->index = index;
+			h->generation = actor_slots[index].generation;
+			luaL_setmetatable(L, T_ACTOR_META);
+		}
+
+		// Starts a script tick: watch() then the update of every script, on the
+		// script thread.  Call sync() before touching lua or the scripts again.
+		static void kick(float delta)
+		{
+			if (!is_inited)
+			{
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> l(script_mutex);
+				script_delta = delta;
+				script_pending = true;
+			}
+			script_wake.notify_one();
+		}
+
+		// Waits for the script tick to finish and applies what it recorded to the world.
+		static void sync()
+		{
+			TRIGGER_PROFILE_SCOPE("tlua::sync");
+			if (!is_inited)
+			{
+				return;
+			}
+			{
+				std::unique_lock<std::mutex> l(script_mutex);
+				script_done.wait(l, [] { return !script_pending; });
+			}
+
+			for (auto &c : commands)
+			{
+				if (c.type == cmd_exec)
+				{
+					cmd->Exec(c.name.c_str());
+					continue;
+				}
+
+				auto &slot = actor_slots[c.actor.index];
+				if (slot.generation != c.actor.generation || slot.actor == nullptr)
+				{
+					continue;
+				}
+
+				auto &t = slot.actor->s_transform;
+				switch (c.type)
+				{
+				case cmd_set_position: t.position.x = c.x; t.position.y = c.y; t.position.z = c.z; break;
+				case cmd_set_rotation: t.rotation.x = c.x; t.rotation.y = c.y; t.rotation.z = c.z; break;
+				case cmd_set_scale: t.scale.x = c.x; t.scale.y = c.y; t.scale.z = c.z; break;
+				case cmd_move: t.position.x += c.x; t.position.y += c.y; t.position.z += c.z; break;
+				case cmd_rotate: t.rotation.x += c.x; t.rotation.y += c.y; t.rotation.z += c.z; break;
+				case cmd_rename: slot.actor->name = c.name; break;
+				case cmd_spawn: tlua::world->add(slot.actor); break;
+				}
+			}
+			commands.clear();
+		}
+
+		static void shutdown()
+		{
+			if (!script_thread.joinable())
+			{
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> l(script_mutex);
+				script_quit = true;
+			}
+			script_wake.notify_one();
+			script_thread.join();
+		}
+
+		static void script_main()
+		{
+			TRIGGER_PROFILE_THREAD("lua");
+			for (;;)
+			{
+				float delta;
+				{
+					std::unique_lock<std::mutex> l(script_mutex);
+					script_wake.wait(l, [] { return script_quit || script_pending; });
+					if (script_quit)
+					{
+						return;
+					}
+					delta = script_delta;
+				}
+
+				TRIGGER_PROFILE_SCOPE("tlua::tick");
+				watch();
+				_load_update_func(delta);
+
+				{
+					std::lock_guard<std::mutex> l(script_mutex);
+					script_pending = false;
+				}
+				script_done.notify_all();
+			}
+		}
+
 		static bool open_lua_editor(std::string path, bool* window)
 		{
 			if (!tlua::path.compare(path))
@@ -79,6 +803,7 @@ namespace trigger
 							ofstream o(path);
 							o << textToSave;
 							o.close();
+							reload(path);
 						}
 					}
 					if (ImGui::MenuItem("Quit", "Alt-F4"))
@@ -117,111 +842,399 @@ namespace trigger
 
 					ImGui::Separator();
 
-					if (ImGui::MenuItem("Select all", nullptr, nullptr))
-						edit.SetSelection(TextEditor::Coordinates(), TextEditor::Coordinates(edit.GetTotalLines(), 0));
+					if (ImGui::MenuItem("Select all", nullptr, nullptr))
+						edit.SetSelection(TextEditor::Coordinates(), TextEditor::Coordinates(edit.GetTotalLines(), 0));
+
+					ImGui::EndMenu();
+				}
+
+				if (ImGui::BeginMenu("View"))
+				{
+					ImGui::MenuItem("Profiler", nullptr, &show_profiler);
+					ImGui::Separator();
+					if (ImGui::MenuItem("Dark palette"))
+						edit.SetPalette(TextEditor::GetDarkPalette());
+					if (ImGui::MenuItem("Light palette"))
+						edit.SetPalette(TextEditor::GetLightPalette());
+					ImGui::EndMenu();
+				}
+				ImGui::EndMenuBar();
+			}
+
+			ImGui::Text("%6d/%-6d %6d lines  | %s | %s | %s | %s", cpos.mLine + 1, cpos.mColumn + 1, edit.GetTotalLines(),
+				edit.IsOverwrite() ? "Ovr" : "Ins",
+				edit.CanUndo() ? "*" : " ",
+				edit.GetLanguageDefinition().mName.c_str(), tlua::path.c_str());
+
+			edit.Render("TextEditor");
+			editor_pos = ImGui::GetWindowPos();
+			editor_size = ImGui::GetWindowSize();
+			ImGui::End();
+
+		}
+
+		static bool save_default_lua_file(std::string path)
+		{
+			//Read Default lua file and copy
+			std::ifstream i("lua/lua_default", std::ios::binary);
+			if (!i.is_open())
+			{
+				return false;
+			}
+
+			ofstream o(path, std::ios::binary);
+			if (!o.is_open())
+			{
+				return false;
+			}
+			o << i.rdbuf();
+			return o.good();
+		}
+
+		// init()			// constructor
+		// update(delta)	// tick
+		// destroy()		// removed
+		// Calls update(delta) of every script in one pass.  The callbacks were
+		// resolved when the scripts were loaded, so this is no name lookup.
+		static void _load_update_func(float delta)
+		{
+			TRIGGER_PROFILE_SCOPE("tlua::_load_update_func");
+			if (!is_inited || scripts.empty())
+			{
+				return;
+			}
+
+			lua_pushcfunction(L, traceback);
+			int handler = lua_gettop(L);
+			for (auto &s : scripts)
+			{
+				if (s.update == LUA_NOREF || !s.owner->active)
+				{
+					continue;
+				}
+
+				int64_t begin = hires_clock::now_ns();
+				memory.current = s.memory;
+				lua_rawgeti(L, LUA_REGISTRYINDEX, s.update);
+				lua_pushnumber(L, lua_Number(delta));
+				if (lua_pcall(L, 1, 0, handler) != LUA_OK)
+				{
+					report(s, lua_tostring(L, -1));
+					lua_pop(L, 1);
+				}
+				s.last_ms = (hires_clock::now_ns() - begin) * 1e-6f;
+				s.avg_ms += (s.last_ms - s.avg_ms) * 0.05f;
+				s.max_ms = std::max<float>(s.max_ms, s.last_ms);
 
-					ImGui::EndMenu();
+				auto &m = memory.get(s.memory);
+				if (delta > 0.0f)
+				{
+					s.alloc_rate += ((m.allocated - s.last_allocated) / delta - s.alloc_rate) * 0.05f;
 				}
+				s.last_allocated = m.allocated;
+			}
+			memory.current = 0;
+			lua_pop(L, 1);
+		}
 
-				if (ImGui::BeginMenu("View"))
+		// Per script cost of update(), most expensive first.
+		static void draw_script_stats(bool *window)
+		{
+			if (!ImGui::Begin("Lua Scripts", window))
+			{
+				ImGui::End();
+				return;
+			}
+
+			std::vector<script*> sorted;
+			float total = 0.0f;
+			for (auto &s : scripts)
+			{
+				sorted.push_back(&s);
+				total += s.last_ms;
+			}
+			std::sort(sorted.begin(), sorted.end(), [](const script *a, const script *b) { return a->avg_ms > b->avg_ms; });
+
+			ImGui::Text("%u scripts, %.3f ms last frame", (unsigned int)sorted.size(), total);
+			ImGui::SameLine();
+			if (ImGui::Button("Reset"))
+			{
+				for (auto &s : scripts)
 				{
-					if (ImGui::MenuItem("Dark palette"))
-						edit.SetPalette(TextEditor::GetDarkPalette());
-					if (ImGui::MenuItem("Light palette"))
-						edit.SetPalette(TextEditor::GetLightPalette());
-					ImGui::EndMenu();
+					s.max_ms = 0.0f;
+					s.errors = 0;
 				}
-				ImGui::EndMenuBar();
+				gc_max_ms = 0.0f;
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Memory Report"))
+			{
+				report_memory();
 			}
 
-			ImGui::Text("%6d/%-6d %6d lines  | %s | %s | %s | %s", cpos.mLine + 1, cpos.mColumn + 1, edit.GetTotalLines(),
-				edit.IsOverwrite() ? "Ovr" : "Ins",
-				edit.CanUndo() ? "*" : " ",
-				edit.GetLanguageDefinition().mName.c_str(), tlua::path.c_str());
+			int budget = (int)(script_budget / 1024);
+			if (ImGui::SliderInt("budget per script (KB)", &budget, 64, 64 * 1024))
+			{
+				set_script_budget((size_t)budget * 1024);
+			}
+			ImGui::Text("pools %.1f KB, large blocks %.1f KB", memory.pooled_bytes() / 1024.0f, memory.heap_bytes() / 1024.0f);
 
-			edit.Render("TextEditor");
+			ImGui::SliderFloat("gc budget (ms)", &gc_budget_ms, 0.05f, 4.0f);
+			ImGui::SliderInt("gc pause (%)", &gc_pause, 10, 400);
+			ImGui::Text("gc %.3f ms last frame, %.3f avg, %.3f max, %u cycles, %d KB in use%s",
+				gc_last_ms, gc_avg_ms, gc_max_ms, gc_cycles, lua_gc(L, LUA_GCCOUNT, 0), gc_running ? ", collecting" : "");
+			ImGui::Separator();
+
+			ImGui::Columns(8, "scripts");
+			ImGui::Text("actor"); ImGui::NextColumn();
+			ImGui::Text("file"); ImGui::NextColumn();
+			ImGui::Text("avg ms"); ImGui::NextColumn();
+			ImGui::Text("max ms"); ImGui::NextColumn();
+			ImGui::Text("errors"); ImGui::NextColumn();
+			ImGui::Text("live KB"); ImGui::NextColumn();
+			ImGui::Text("alloc KB/s"); ImGui::NextColumn();
+			ImGui::Text("refused"); ImGui::NextColumn();
+			ImGui::Separator();
+			for (auto s : sorted)
+			{
+				auto &m = memory.get(s->memory);
+				ImGui::Text("%s", s->owner->name.c_str()); ImGui::NextColumn();
+				ImGui::Text("%s", s->file.c_str()); ImGui::NextColumn();
+				ImGui::Text("%.3f", s->avg_ms); ImGui::NextColumn();
+				ImGui::Text("%.3f", s->max_ms); ImGui::NextColumn();
+				ImGui::Text("%u", s->errors); ImGui::NextColumn();
+				ImGui::Text("%.1f", m.live / 1024.0f); ImGui::NextColumn();
+				ImGui::Text("%.1f", s->alloc_rate / 1024.0f); ImGui::NextColumn();
+				ImGui::Text("%llu", (unsigned long long)m.refused); ImGui::NextColumn();
+			}
+			ImGui::Columns(1);
 			ImGui::End();
+		}
 
+		// Starts or stops sampling.  Only while the scripts are idle.
+		static void set_profiling(bool enable)
+		{
+			if (!is_inited)
+			{
+				return;
+			}
+			profiling = enable;
+			if (enable)
+			{
+				lua_sethook(L, profile_hook, LUA_MASKCOUNT, profile_interval);
+			}
+			else
+			{
+				lua_sethook(L, nullptr, 0, 0);
+			}
 		}
 
-		static bool save_default_lua_file(std::string path)
+		static void reset_profile()
 		{
-			//Read Default lua file and copy
-			std::ifstream i("lua/lua_default");
-			if (i.is_open())
+			profile_samples = 0;
+			profile_functions.clear();
+			profile_files.clear();
+			profile_stacks.clear();
+		}
+
+		// Folded stacks, one "root;...;leaf count" line per stack, as read by
+		// flamegraph.pl and speedscope.
+		static bool export_profile(const std::string &file)
+		{
+			ofstream o(file);
+			if (!o.is_open())
 			{
-				std::string data;
-				std::string chunk;
-				while (std::getline(i, data))
-				{
-					chunk += data;
-					chunk.push_back('\n');
-				}
+				return false;
+			}
+			for (auto &stack : profile_stacks)
+			{
+				o << stack.first << ' ' << stack.second << '\n';
+			}
+			return o.good();
+		}
+
+		// Samples per function and per script file, next to the Trigger Editor.
+		static void draw_profiler()
+		{
+			if (!show_profiler)
+			{
+				return;
+			}
+			ImGui::SetNextWindowPos(ImVec2(editor_pos.x + editor_size.x, editor_pos.y), ImGuiCond_FirstUseEver);
+			ImGui::SetNextWindowSize(ImVec2(500, 600), ImGuiCond_FirstUseEver);
+			if (!ImGui::Begin("Lua Profiler", &show_profiler))
+			{
+				ImGui::End();
+				return;
+			}
 
-				ofstream o(path);
-				if (o.is_open())
+			bool enable = profiling;
+			if (ImGui::Checkbox("sampling", &enable))
+			{
+				set_profiling(enable);
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Reset"))
+			{
+				reset_profile();
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Export"))
+			{
+				if (export_profile("lua_profile.folded"))
 				{
-					o << chunk;
-					o.close();
-					return true;
+					post_log("[log] lua profile saved to lua_profile.folded (%d stacks)", (int)profile_stacks.size());
 				}
 				else
 				{
-					return false;
+					post_log("[error] can't save lua_profile.folded");
 				}
 			}
-			else
+			if (ImGui::SliderInt("instructions per sample", &profile_interval, 100, 100000) && profiling)
 			{
-				return false;
+				set_profiling(true);
 			}
-		}
-		// init()			// constructor
-		// update(delta)	// tick
-		// destroy()		// removed
-		static void _load_init_func()
-		{
-			if (close == false)
+			ImGui::Text("%llu samples", (unsigned long long)profile_samples);
+			float scale = profile_samples > 0 ? 100.0f / profile_samples : 0.0f;
+
+			if (ImGui::CollapsingHeader("Files", ImGuiTreeNodeFlags_DefaultOpen))
 			{
-				if (lua_getglobal(tlua::L, "init"))
+				std::vector<std::pair<std::string, uint64_t>> files(profile_files.begin(), profile_files.end());
+				std::sort(files.begin(), files.end(), [](const std::pair<std::string, uint64_t> &a, const std::pair<std::string, uint64_t> &b) { return a.second > b.second; });
+				ImGui::Columns(2, "profile files");
+				for (auto &f : files)
 				{
-					lua_pcall(tlua::L, 0, 0, 0);
+					ImGui::Text("%s", f.first.c_str()); ImGui::NextColumn();
+					ImGui::Text("%5.1f %%", f.second * scale); ImGui::NextColumn();
 				}
-				else
+				ImGui::Columns(1);
+			}
+
+			if (ImGui::CollapsingHeader("Functions", ImGuiTreeNodeFlags_DefaultOpen))
+			{
+				std::vector<std::pair<const std::string*, const profile_entry*>> functions;
+				for (auto &f : profile_functions)
 				{
-					tlua::cmd->AddLog("[lua-err] Can't find init() in lua file");
+					functions.push_back(std::make_pair(&f.first, &f.second));
 				}
+				std::sort(functions.begin(), functions.end(), [](const std::pair<const std::string*, const profile_entry*> &a, const std::pair<const std::string*, const profile_entry*> &b) { return a.second->self > b.second->self; });
+				ImGui::Columns(3, "profile functions");
+				ImGui::Text("function"); ImGui::NextColumn();
+				ImGui::Text("self"); ImGui::NextColumn();
+				ImGui::Text("total"); ImGui::NextColumn();
+				ImGui::Separator();
+				for (auto &f : functions)
+				{
+					ImGui::Text("%s", f.first->c_str()); ImGui::NextColumn();
+					ImGui::Text("%5.1f %%", f.second->self * scale); ImGui::NextColumn();
+					ImGui::Text("%5.1f %%", f.second->total * scale); ImGui::NextColumn();
+				}
+				ImGui::Columns(1);
 			}
+			ImGui::End();
 		}
 
-		static void _load_update_func(float delta)
+		// Incremental collection within the frame budget.  Call once a frame when
+		// the CPU would otherwise wait, after the frame has been submitted.
+		static void gc_step()
 		{
-			if (close == false)
+			TRIGGER_PROFILE_SCOPE("tlua::gc_step");
+			if (!is_inited)
+			{
+				return;
+			}
+
+			int64_t begin = hires_clock::now_ns();
+			int kb = lua_gc(L, LUA_GCCOUNT, 0);
+			if (!gc_running && kb < gc_threshold_kb)
+			{
+				gc_last_ms = 0.0f;
+			}
+			else
 			{
-				if (is_inited)
+				if (kb > gc_threshold_kb * 4)
 				{
-					if (lua_getglobal(tlua::L, "update"))
-					{
-						lua_pushnumber(tlua::L, lua_Number(delta));
-						lua_pcall(tlua::L, 1, 0, 0);
-					}
-					else
+					// The steps fall far behind the scripts, a full pause beats running out.
+					lua_gc(L, LUA_GCCOLLECT, 0);
+					gc_cycle_done();
+				}
+				else
+				{
+					gc_running = true;
+					do
 					{
-						tlua::cmd->AddLog("[lua-err] Can't find update() in lua file");
-					}
+						// One basic step, LUA_GCSTEP returns 1 when it ends a cycle.
+						if (lua_gc(L, LUA_GCSTEP, 0))
+						{
+							gc_cycle_done();
+							break;
+						}
+					} while ((hires_clock::now_ns() - begin) * 1e-6f < gc_budget_ms);
 				}
+				gc_last_ms = (hires_clock::now_ns() - begin) * 1e-6f;
 			}
+			gc_avg_ms += (gc_last_ms - gc_avg_ms) * 0.05f;
+			gc_max_ms = std::max<float>(gc_max_ms, gc_last_ms);
+		}
+
+		static void gc_cycle_done()
+		{
+			gc_running = false;
+			gc_cycles++;
+			gc_threshold_kb = std::max<int>(lua_gc(L, LUA_GCCOUNT, 0) * (100 + gc_pause) / 100, 256);
 		}
 
-		static void _load_destroy_func()
+		// Memory of every script, to the console.
+		static void report_memory()
 		{
-			if (lua_getglobal(tlua::L, "destroy"))
+			post_log("[log] lua memory : pools %.1f KB, large blocks %.1f KB, shared %.1f KB",
+				memory.pooled_bytes() / 1024.0f, memory.heap_bytes() / 1024.0f, memory.shared_bytes() / 1024.0f);
+			for (auto &s : scripts)
 			{
-				lua_pcall(tlua::L, 0, 0, 0);
-				tlua::close = true;
+				auto &m = memory.get(s.memory);
+				post_log("[log] %s (%s) : live %.1f KB, peak %.1f KB of %.1f KB, %.1f KB/s, %llu refused",
+					s.owner->name.c_str(), s.file.c_str(), m.live / 1024.0f, m.peak / 1024.0f, m.budget / 1024.0f,
+					s.alloc_rate / 1024.0f, (unsigned long long)m.refused);
 			}
-			else
+		}
+
+		// Caps the live bytes of every script, 0 is no limit.
+		static void set_script_budget(size_t bytes)
+		{
+			script_budget = bytes;
+			for (auto &s : scripts)
+			{
+				memory.get(s.memory).budget = bytes;
+			}
+		}
+
+		static int panic(lua_State *L)
+		{
+			post_log("[error] lua panic : %s", lua_tostring(L, -1));
+			return 0;
+		}
+
+		// owner was deleted: runs destroy() of its scripts, drops them and
+		// invalidates the handles of owner.
+		static void _load_destroy_func(trigger::actor *owner)
+		{
+			if (is_inited)
 			{
-				tlua::cmd->AddLog("[lua-err] Can't find destroy() in lua file");
+				for (auto i = scripts.begin(); i != scripts.end();)
+				{
+					if (i->owner == owner)
+					{
+						call(*i, i->destroy);
+						unref(*i);
+						memory.remove_owner(i->memory);
+						i = scripts.erase(i);
+					}
+					else
+					{
+						++i;
+					}
+				}
+				release_actor(owner);
 			}
 		}
 
@@ -232,7 +1245,11 @@ namespace trigger
 
 		static tlua::error init(trigger::ui::console *cmd, trigger::component_world *world, trigger::actor *target)
 		{
-			tlua::L = luaL_newstate();
+			tlua::L = lua_newstate(lua_allocator::alloc, &memory);
+			lua_atpanic(L, panic);
+
+			// The engine drives the collector, see gc_step().
+			lua_gc(L, LUA_GCSTOP, 0);
 			tlua::world = world;
 			tlua::cmd = cmd;
 			tlua::target = target;
@@ -243,166 +1260,434 @@ namespace trigger
 				//if u Updated this .h, u must add new func in here!
 				lua_register(L, "t_new_actor", t_new_actor);
 				lua_register(L, "t_print", t_print);
-				lua_register(L, "t_rotation", t_rotation);
-				lua_register(L, "t_set_rotation", t_set_rotation);
-				lua_register(L, "t_set_scale", t_set_scale);
-				lua_register(L, "t_set_position", t_set_position);
-				lua_register(L, "t_move", t_move);
+				lua_register(L, "t_rotation", t_transform<cmd_rotate>);
+				lua_register(L, "t_set_rotation", t_transform<cmd_set_rotation>);
+				lua_register(L, "t_set_scale", t_transform<cmd_set_scale>);
+				lua_register(L, "t_set_position", t_transform<cmd_set_position>);
+				lua_register(L, "t_move", t_transform<cmd_move>);
+				lua_register(L, "t_find_actors", t_find_actors);
+				lua_register(L, "t_move_all", t_bulk<cmd_move>);
+				lua_register(L, "t_rotate_all", t_bulk<cmd_rotate>);
+				lua_register(L, "t_set_position_all", t_bulk<cmd_set_position>);
+				lua_register(L, "t_set_rotation_all", t_bulk<cmd_set_rotation>);
+				lua_register(L, "t_set_scale_all", t_bulk<cmd_set_scale>);
+				lua_register(L, "t_exec", t_exec);
+				lua_register(L, "t_cvar", t_cvar);
+				lua_register(L, "t_set_cvar", t_set_cvar);
 			}
+			register_actor_meta();
+			register_commands();
 
 			is_inited = true;
+			script_thread = std::thread(script_main);
 			return  error::None;
 		}
 
+		// Loads file as a script of owner, in an environment of its own, and runs its init().
+		// Loading the same file again for the same owner replaces the previous instance.
+		static tlua::error attach(trigger::actor *owner, const std::string file)
+		{
+			if (!tlua::is_inited)
+			{
+				post_log("[error] Lua is un-inited.. call trigger::tlua::init(...)");
+				return error::NotInited;
+			}
+
+			if (load_chunk(file) != LUA_OK)
+			{
+				post_log("[error] Can't load %s : %s", file.c_str(), lua_tostring(L, -1));
+				lua_pop(L, 1);
+				return error::CantOpen;
+			}
+
+			// Everything the script allocates from here on is charged to it.
+			unsigned int mem = memory.add_owner(script_budget);
+			memory.current = mem;
+
+			// env = setmetatable({ self = owner }, { __index = _G })
+			lua_newtable(L);
+			push_actor(L, owner);
+			lua_setfield(L, -2, "self");
+			lua_newtable(L);
+			lua_pushglobaltable(L);
+			lua_setfield(L, -2, "__index");
+			lua_setmetatable(L, -2);
+
+			// The first upvalue of a main chunk is its _ENV.
+			lua_pushvalue(L, -1);
+			int env = luaL_ref(L, LUA_REGISTRYINDEX);
+			lua_setupvalue(L, -2, 1);
+
+			lua_pushcfunction(L, traceback);
+			lua_insert(L, -2);
+			int status = lua_pcall(L, 0, 0, -2);
+			memory.current = 0;
+			if (status != LUA_OK)
+			{
+				post_log("[error] %s : %s", file.c_str(), lua_tostring(L, -1));
+				lua_pop(L, 2);
+				luaL_unref(L, LUA_REGISTRYINDEX, env);
+				memory.remove_owner(mem);
+				return error::ScriptError;
+			}
+			lua_pop(L, 1);
+
+			for (auto i = scripts.begin(); i != scripts.end(); ++i)
+			{
+				if (i->owner == owner && i->file == file)
+				{
+					unref(*i);
+					memory.remove_owner(i->memory);
+					scripts.erase(i);
+					break;
+				}
+			}
+
+			script s;
+			s.owner = owner;
+			s.file = file;
+			s.env = env;
+			s.memory = mem;
+			s.init = ref_func(env, "init");
+			s.update = ref_func(env, "update");
+			s.destroy = ref_func(env, "destroy");
+			s.modified = modified_time(file);
+			scripts.push_back(s);
+
+			if (s.init == LUA_NOREF)
+			{
+				post_log("[lua-err] Can't find init() in %s", file.c_str());
+			}
+			return call(scripts.back(), scripts.back().init) ? error::None : error::ScriptError;
+		}
+
 		static tlua::error run(const std::string file)
 		{
-			if (tlua::is_inited)
+			return attach(tlua::target, file);
+		}
+
+		// Console commands of the lua side.  They run from the console, on the
+		// main thread while the scripts are idle.
+		static void register_commands()
+		{
+			auto &c = cmd->Commands;
+			c.add("lua run", "attaches a script to the default target", { { "file", arg_text, false } }, [](const command_args &a)
+			{
+				run(a.get_string(0));
+			});
+			c.add("lua profile", "starts or stops sampling the scripts", { { "on", arg_bool, false } }, [](const command_args &a)
+			{
+				set_profiling(a.get_bool(0));
+			});
+			c.add("lua profile reset", "drops the samples", {}, [](const command_args&)
 			{
-				if (!luaL_dofile(tlua::L, file.c_str()))
+				reset_profile();
+			});
+			c.add("lua profile export", "saves the samples as folded stacks", { { "file", arg_string, true } }, [](const command_args &a)
+			{
+				std::string file = a.has(0) ? a.get_string(0) : "lua_profile.folded";
+				if (export_profile(file))
 				{
-					tlua::_load_init_func();
-					close = false;
-					return error::None;
+					post_log("[log] lua profile saved to %s (%d stacks)", file.c_str(), (int)profile_stacks.size());
 				}
 				else
 				{
-					tlua::cmd->AddLog("[error] Can't load %s", file.c_str());
-					lua_close(tlua::L);
-					return error::CantOpen;
+					post_log("[error] can't save %s", file.c_str());
 				}
-			}
-			else
+			});
+			c.add("lua profiler", "opens the lua profiler", {}, [](const command_args&)
 			{
-				tlua::cmd->AddLog("[error] Lua is un-inited.. call trigger::tlua::init(...)");
-				return error::NotInited;
-			}
+				show_profiler = true;
+			});
 		}
 
-		//Print msg in console.
-		static int t_print(lua_State *L)
+		static time_t modified_time(const std::string &file)
 		{
-			auto msg = lua_tostring(L, 1);
-			tlua::cmd->AddLog("[lua-log] %s", msg);
-			return 0;
+			struct stat st;
+			return stat(file.c_str(), &st) == 0 ? st.st_mtime : 0;
 		}
 
-		//Create new actor in world.
-		static int t_new_actor(lua_State *L)
+		// Runs file again in the environment of every script loaded from it, so
+		// their state is kept and only the functions are replaced.  init() is not
+		// called again, reload() is when the script has one.  A script whose chunk
+		// fails keeps its previous callbacks, and a file that does not compile
+		// leaves every script as it was.
+		static tlua::error reload(const std::string &file)
 		{
-			// Get Param String
-			auto name = lua_tostring(L, 1);
-			tlua::cmd->AddLog("[lua-log] Create New Actor %s", name);
+			if (!tlua::is_inited)
+			{
+				return error::NotInited;
+			}
 
-			auto t = new trigger::actor();
-			t->name = name;
-			tlua::world->add(t);
+			// Before anything can fail, so that watch() does not retry a broken
+			// file for the other scripts of it until it changes again.
+			time_t modified = modified_time(file);
+			for (auto &s : scripts)
+			{
+				if (s.file == file)
+				{
+					s.modified = modified;
+				}
+			}
 
-			lua_pushstring(L, name);
-			return 1;
+			unsigned int count = 0;
+			tlua::error result = error::None;
+			for (auto &s : scripts)
+			{
+				if (s.file != file)
+				{
+					continue;
+				}
+
+				// Every script needs a closure of its own, the _ENV upvalue is shared
+				// with the functions the chunk defines.
+				if (load_chunk(file) != LUA_OK)
+				{
+					post_log("[error] Can't reload %s : %s", file.c_str(), lua_tostring(L, -1));
+					lua_pop(L, 1);
+					result = error::CantOpen;
+					break;
+				}
+				lua_rawgeti(L, LUA_REGISTRYINDEX, s.env);
+				lua_setupvalue(L, -2, 1);
+
+				lua_pushcfunction(L, traceback);
+				lua_insert(L, -2);
+				memory.current = s.memory;
+				int status = lua_pcall(L, 0, 0, -2);
+				memory.current = 0;
+				if (status != LUA_OK)
+				{
+					report(s, lua_tostring(L, -1));
+					lua_pop(L, 2);
+					result = error::ScriptError;
+					continue;
+				}
+				lua_pop(L, 1);
+
+				luaL_unref(L, LUA_REGISTRYINDEX, s.init);
+				luaL_unref(L, LUA_REGISTRYINDEX, s.update);
+				luaL_unref(L, LUA_REGISTRYINDEX, s.destroy);
+				s.init = ref_func(s.env, "init");
+				s.update = ref_func(s.env, "update");
+				s.destroy = ref_func(s.env, "destroy");
+
+				int on_reload = ref_func(s.env, "reload");
+				call(s, on_reload);
+				luaL_unref(L, LUA_REGISTRYINDEX, on_reload);
+				count++;
+			}
+
+			if (count != 0)
+			{
+				post_log("[log] Reloaded %s for %u actors", file.c_str(), count);
+			}
+			return result;
 		}
 
-		//set rotate actor
-		static int t_set_rotation(lua_State *L)
+		static void reload_all()
 		{
-			std::string name = lua_tostring(L, 1);
-			float x = (float)(lua_tonumber(L, 2));
-			float y = (float)lua_tonumber(L, 3);
-			float z = (float)lua_tonumber(L, 4);
-			auto actors = tlua::world->get_components <trigger::actor>();
-			for (auto a : actors)
+			std::vector<std::string> files;
+			for (auto &s : scripts)
 			{
-				if (a->name.compare(name) == 0)
+				if (std::find(files.begin(), files.end(), s.file) == files.end())
 				{
-					a->s_transform.rotation.x += x;
-					a->s_transform.rotation.y += y;
-					a->s_transform.rotation.z += z;
+					files.push_back(s.file);
 				}
 			}
-			return 0;
+			for (auto &f : files)
+			{
+				reload(f);
+			}
 		}
 
-		static int t_set_position(lua_State *L)
+		// Reloads the files changed on disk.  Call every frame, the files are
+		// looked at twice a second.
+		static void watch()
 		{
-			std::string name = lua_tostring(L, 1);
-			float x = (float)(lua_tonumber(L, 2));
-			float y = (float)lua_tonumber(L, 3);
-			float z = (float)lua_tonumber(L, 4);
-			auto actors = tlua::world->get_components <trigger::actor>();
-			for (auto a : actors)
+			static int64_t last = hires_clock::now_ns();
+			int64_t now = hires_clock::now_ns();
+			if (now - last < 500000000)
+			{
+				return;
+			}
+			last = now;
+
+			std::vector<std::string> changed;
+			for (auto &s : scripts)
 			{
-				if (a->name.compare(name) == 0)
+				if (std::find(changed.begin(), changed.end(), s.file) == changed.end() &&
+					modified_time(s.file) != s.modified)
 				{
-					a->s_transform.position.x = x;
-					a->s_transform.position.y = y;
-					a->s_transform.position.z = z;
+					changed.push_back(s.file);
 				}
 			}
+			for (auto &f : changed)
+			{
+				reload(f);
+			}
+		}
+
+		//Print msg in console.
+		static int t_print(lua_State *L)
+		{
+			auto msg = lua_tostring(L, 1);
+			tlua::cmd->Log(log_info, "lua", "[lua-log] %s", msg);
+			return 0;
+		}
+
+		//Run a console command line.  It runs at the end of the tick, like the
+		// changes to the world.
+		static int t_exec(lua_State *L)
+		{
+			command c;
+			c.type = cmd_exec;
+			c.x = c.y = c.z = 0;
+			c.name = luaL_checkstring(L, 1);
+			commands.push_back(std::move(c));
 			return 0;
 		}
 
-		static int t_move(lua_State *L)
+		//Value of a cvar, nil when there is none.  Cvars are safe to read and
+		// set from the script thread, so these take effect right away.
+		static int t_cvar(lua_State *L)
 		{
-			std::string name = lua_tostring(L, 1);
-			float x = (float)(lua_tonumber(L, 2));
-			float y = (float)lua_tonumber(L, 3);
-			float z = (float)lua_tonumber(L, 4);
-			auto actors = tlua::world->get_components <trigger::actor>();
-			for (auto a : actors)
+			cvar *c = cvars::find(luaL_checkstring(L, 1));
+			if (c == nullptr)
 			{
-				if (a->name.compare(name) == 0)
-				{
-					a->s_transform.position.x += x;
-					a->s_transform.position.y += y;
-					a->s_transform.position.z += z;
-				}
+				lua_pushnil(L);
 			}
-			return 0;
+			else if (c->type == cvar_int)
+			{
+				lua_pushinteger(L, c->get_int());
+			}
+			else if (c->type == cvar_float)
+			{
+				lua_pushnumber(L, c->get_float());
+			}
+			else if (c->type == cvar_bool)
+			{
+				lua_pushboolean(L, c->get_bool());
+			}
+			else
+			{
+				lua_pushstring(L, c->get_string().c_str());
+			}
+			return 1;
 		}
 
-		static int t_set_scale(lua_State *L)
+		//Set a cvar, false when there is none or value does not fit it.
+		static int t_set_cvar(lua_State *L)
 		{
-			std::string name = lua_tostring(L, 1);
-			float x = (float)(lua_tonumber(L, 2));
-			float y = (float)lua_tonumber(L, 3);
-			float z = (float)lua_tonumber(L, 4);
-			auto actors = tlua::world->get_components <trigger::actor>();
-			for (auto a : actors)
+			cvar *c = cvars::find(luaL_checkstring(L, 1));
+			bool ok = false;
+			if (c != nullptr)
 			{
-				if (a->name.compare(name) == 0)
+				if (lua_isboolean(L, 2))
+				{
+					ok = c->parse(lua_toboolean(L, 2) ? "true" : "false");
+				}
+				else if (lua_type(L, 2) == LUA_TNUMBER && c->type != cvar_string)
+				{
+					c->set(lua_tonumber(L, 2));
+					ok = true;
+				}
+				else
 				{
-					a->s_transform.scale.x = x;
-					a->s_transform.scale.y = y;
-					a->s_transform.scale.z = z;
+					ok = c->parse(luaL_tolstring(L, 2, nullptr));
+					lua_pop(L, 1);
 				}
 			}
+			lua_pushboolean(L, ok);
+			return 1;
+		}
+
+		//Create new actor in world, returns its handle.  It joins the world at
+		// the end of the tick, the handle works right away.
+		static int t_new_actor(lua_State *L)
+		{
+			// Get Param String
+			auto name = luaL_checkstring(L, 1);
+			tlua::cmd->Log(log_info, "lua", "[lua-log] Create New Actor %s", name);
+
+			auto t = new trigger::actor();
+			t->name = name;
+
+			push_actor(L, t);
+			record(cmd_spawn, *(actor_handle*)lua_touserdata(L, -1), 0, 0, 0);
+			return 1;
+		}
+
+		// The actor functions take a handle, or a name for older scripts.
+		// As methods they are actor:move(x, y, z) and so on.  Like every
+		// change to the world, they take effect at the end of the tick.
+		template<command_type Type>
+		static int t_transform(lua_State *L)
+		{
+			auto h = check_handle(L, 1);
+			record(Type, h, (float)lua_tonumber(L, 2), (float)lua_tonumber(L, 3), (float)lua_tonumber(L, 4));
 			return 0;
 		}
 
-		//rotate actor
-		static int t_rotation(lua_State *L)
+		// Bulk versions, one call for a whole group of actors:
+		//   t_move_all(actors, xs, ys, zs)
+		// actors is an array of handles, xs/ys/zs are arrays parallel to it or
+		// numbers applied to every actor.  Stale handles are skipped.
+		// Returns the number of actors changed.
+		template<command_type Type>
+		static int t_bulk(lua_State *L)
 		{
-			if (lua_status(L) == LUA_OK)
+			luaL_checktype(L, 1, LUA_TTABLE);
+			lua_Integer n = luaL_len(L, 1);
+			lua_Integer changed = 0;
+			for (lua_Integer i = 1; i <= n; ++i)
 			{
-				std::string name = lua_tostring(L, 1);
-				float x = (float)(lua_tonumber(L, 2));
-				float y = (float)lua_tonumber(L, 3);
-				float z = (float)lua_tonumber(L, 4);
-				auto actors = tlua::world->get_components <trigger::actor>();
-				for (auto a : actors)
+				actor_handle h;
+				lua_rawgeti(L, 1, i);
+				bool valid = to_handle(L, -1, h);
+				lua_pop(L, 1);
+				if (!valid)
 				{
-					if (a->name.compare(name) == 0)
-					{
-						a->s_transform.rotation.x += x;
-						a->s_transform.rotation.y += y;
-						a->s_transform.rotation.z += z;
-					}
+					continue;
 				}
+
+				record(Type, h, bulk_arg(L, 2, i), bulk_arg(L, 3, i), bulk_arg(L, 4, i));
+				changed++;
 			}
-			else 
+			lua_pushinteger(L, changed);
+			return 1;
+		}
+
+		static float bulk_arg(lua_State *L, int idx, lua_Integer i)
+		{
+			if (lua_type(L, idx) != LUA_TTABLE)
 			{
-				cmd->AddLog("[lua-err] not initialized lua.");
+				return (float)lua_tonumber(L, idx);
 			}
-			return 0;
+			lua_rawgeti(L, idx, i);
+			float v = (float)lua_tonumber(L, -1);
+			lua_pop(L, 1);
+			return v;
+		}
+
+		// Array of handles of the actors whose name starts with prefix.  Meant
+		// to be called once and the result kept for the bulk functions.
+		static int t_find_actors(lua_State *L)
+		{
+			size_t len = 0;
+			const char *prefix = luaL_optlstring(L, 1, "", &len);
+
+			lua_newtable(L);
+			lua_Integer n = 0;
+			for (auto a : tlua::world->get_components<trigger::actor>())
+			{
+				if (a->name.compare(0, len, prefix) == 0)
+				{
+					push_actor(L, a);
+					lua_rawseti(L, -2, ++n);
+				}
+			}
+			return 1;
 		}
 	};
 }
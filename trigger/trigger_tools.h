@@ -3,8 +3,15 @@
 #include <memory>
 #include "imgui.h"
 
-#define T_METHOD methodName(__FUNCTION__).c_str()
-#define T_CLASS className(__FUNCTION__).c_str()
+// "trigger::component::component" from MSVC, the full signature elsewhere.
+#if defined(_MSC_VER)
+#define TRIGGER_FUNCTION __FUNCTION__
+#else
+#define TRIGGER_FUNCTION __PRETTY_FUNCTION__
+#endif
+
+#define T_METHOD methodName(TRIGGER_FUNCTION).c_str()
+#define T_CLASS className(TRIGGER_FUNCTION).c_str()
 
 #define ASSERT(expr, msg, add) \
 static bool click = false;\
@@ -20,13 +27,14 @@ ImGui::End();\
 inline std::string methodName(const std::string& prettyFunction)
 {
 	size_t colons = prettyFunction.find("::");
-	size_t end = prettyFunction.rfind(" ");
 
 	return prettyFunction.substr(colons + 2, prettyFunction.size()) + "()";
 }
 
-inline std::string className(const std::string& prettyFunction)
+inline std::string className(const std::string& function)
 {
+	// The parameters may hold "::" of their own.
+	std::string prettyFunction = function.substr(0, function.find('('));
 	size_t colons = prettyFunction.rfind("::");
 	if (colons == std::string::npos)
 		return "::";